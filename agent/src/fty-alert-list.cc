@@ -24,10 +24,29 @@
 #include <czmq.h>
 #include <fty_log.h>
 
-static int s_ttl_cleanup_timer(zloop_t* /*loop*/, int /*timer_id*/, void* output)
+static const char* CONFIG_FILE = "/etc/fty-alert-list/fty-alert-list.cfg";
+
+// forward tunables of the configuration file to the stream actor
+static void s_configure_stream(zactor_t* stream, zconfig_t* config)
 {
-    zstr_send(output, "TTLCLEANUP");
-    return 0;
+    // rate limiting of publications
+    zstr_sendx(stream, "RATELIMIT", "global", zconfig_get(config, "ratelimit/global/rate", "0"),
+        zconfig_get(config, "ratelimit/global/burst", "100"), nullptr);
+    zstr_sendx(stream, "RATELIMIT", "rule", zconfig_get(config, "ratelimit/rule/rate", "0"),
+        zconfig_get(config, "ratelimit/rule/burst", "10"), nullptr);
+
+    // flap suppression
+    zstr_sendx(stream, "FLAPPING", "*", zconfig_get(config, "flapping/window", "0"), nullptr);
+    zconfig_t* rule = zconfig_child(zconfig_locate(config, "flapping/rules"));
+    while (rule) {
+        zstr_sendx(stream, "FLAPPING", zconfig_name(rule), zconfig_value(rule), nullptr);
+        rule = zconfig_next(rule);
+    }
+
+    // retention of resolved alerts
+    zstr_sendx(stream, "RETENTION", zconfig_get(config, "retention/age", "0"),
+        zconfig_get(config, "retention/count", "0"), zconfig_get(config, "retention/element", "0"), nullptr);
+    zstr_sendx(stream, "HISTORY", zconfig_get(config, "history/age", "0"), nullptr);
 }
 
 int main(int argc, char* argv[])
@@ -35,17 +54,21 @@ int main(int argc, char* argv[])
 
     ManageFtyLog::setInstanceFtylog("fty-alert-list", FTY_COMMON_LOGGING_DEFAULT_CFG);
 
-    bool verbose = false;
+    bool        verbose     = false;
+    const char* config_file = CONFIG_FILE;
 
     int argn;
     for (argn = 1; argn < argc; argn++) {
         if (streq(argv[argn], "--help") || streq(argv[argn], "-h")) {
             puts("fty-alert-list [options] ...");
+            puts("  --config / -c          configuration file [/etc/fty-alert-list/fty-alert-list.cfg]");
             puts("  --verbose / -v         verbose test output");
             puts("  --help / -h            this information");
             return EXIT_SUCCESS;
         } else if (streq(argv[argn], "--verbose") || streq(argv[argn], "-v")) {
             verbose = true;
+        } else if ((streq(argv[argn], "--config") || streq(argv[argn], "-c")) && argn + 1 < argc) {
+            config_file = argv[++argn];
         } else {
             printf("Unknown option: %s\n", argv[argn]);
             return EXIT_FAILURE;
@@ -61,15 +84,35 @@ int main(int argc, char* argv[])
     log_debug("fty-alert-list - Agent providing information about active alerts"); // TODO: rewrite alerts_list_server
                                                                                    // to accept VERBOSE
 
-    // init the alert list (common with stream and mailbox treatment)
-    init_alert(verbose); // read alerts state_file
+    zconfig_t* config = zconfig_load(config_file);
+    if (config)
+        log_info("using configuration file %s", config_file);
+    else
+        log_info("configuration file %s not loaded, using defaults", config_file);
 
-    // initialize actors and timer for stream
+    // init the alert list (common with stream and mailbox treatment)
+    // stream workers, each owning a partition of the alerts (0 - one per CPU, up to 4)
+    size_t workers = config ? size_t(atoi(zconfig_get(config, "stream/workers", "0"))) : 0;
+    // state handed off by the previous process is trusted only if handoff is configured
+    bool handoff = config && atoi(zconfig_get(config, "checkpoint/handoff", "0")) != 0;
+    init_alert(verbose, workers, handoff); // starts loading alerts state_file in the background
+
+    // initialize actors (stream actor resolves expired alerts on its own)
+    // checkpoint actor first, stream workers journal their changes to it from their start
+
+    zactor_t* alert_list_server_checkpoint = zactor_new(fty_alert_list_server_checkpoint, nullptr);
+    if (!alert_list_server_checkpoint) {
+        log_fatal("alert_list_server_checkpoint creation failed");
+        zconfig_destroy(&config);
+        return EXIT_FAILURE;
+    }
 
     const char* endpoint                  = "ipc://@/malamute";
     zactor_t*   alert_list_server_mailbox = zactor_new(fty_alert_list_server_mailbox, const_cast<char*>(endpoint));
     if (!alert_list_server_mailbox) {
         log_fatal("alert_list_server_mailbox creation failed");
+        zactor_destroy(&alert_list_server_checkpoint);
+        zconfig_destroy(&config);
         return EXIT_FAILURE;
     }
 
@@ -77,28 +120,29 @@ int main(int argc, char* argv[])
     if (!alert_list_server_stream) {
         log_fatal("alert_list_server_stream creation failed");
         zactor_destroy(&alert_list_server_mailbox);
+        zactor_destroy(&alert_list_server_checkpoint);
+        zconfig_destroy(&config);
         return EXIT_FAILURE;
     }
 
-    zloop_t* ttlcleanup_stream = zloop_new();
-    if (!ttlcleanup_stream) {
-        log_fatal("ttlcleanup_stream creation failed");
-        zactor_destroy(&alert_list_server_stream);
-        zactor_destroy(&alert_list_server_mailbox);
-        return EXIT_FAILURE;
+    if (config) {
+        s_configure_stream(alert_list_server_stream, config);
+        zstr_sendx(alert_list_server_checkpoint, "CHECKPOINT", zconfig_get(config, "checkpoint/interval", "60"),
+            zconfig_get(config, "checkpoint/changes", "1000"), zconfig_get(config, "checkpoint/handoff", "0"),
+            nullptr);
+        zstr_sendx(alert_list_server_checkpoint, "MERGE", zconfig_get(config, "checkpoint/merge", "50"), nullptr);
+        zstr_sendx(alert_list_server_mailbox, "METRICS", zconfig_get(config, "metrics/interval", "0"), nullptr);
+        zconfig_destroy(&config);
     }
-    zloop_timer(ttlcleanup_stream, 60 * 1000, 0, s_ttl_cleanup_timer, alert_list_server_stream);
-    zloop_start(ttlcleanup_stream);
 
     while (!zsys_interrupted) {
         sleep(1000);
     }
 
-    save_alerts();
-
-    zloop_destroy(&ttlcleanup_stream);
+    // checkpoint actor saves the state once the store does not change anymore
     zactor_destroy(&alert_list_server_stream);
     zactor_destroy(&alert_list_server_mailbox);
+    zactor_destroy(&alert_list_server_checkpoint);
     destroy_alert();
 
     log_info("fty-alert-list ended");
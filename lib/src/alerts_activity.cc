@@ -0,0 +1,442 @@
+/*  =========================================================================
+    alerts_activity - Time indexed log of alert activity periods
+
+    Copyright (C) 2014 - 2020 Eaton
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+    =========================================================================
+ */
+
+
+/*
+@header
+    alerts_activity - Time indexed log of alert activity periods
+@discuss
+@end
+ */
+
+#include "alerts_activity.h"
+#include "alerts_io.h"
+#include "alerts_utils.h"
+#include <algorithm>
+#include <fcntl.h>
+#include <fty_common.h>
+#include <fty_log.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// record framing: size (4), period (size), crc32 (4)
+#define RECORD_OVERHEAD 8
+// period: start (8), end (8), then rule, element and severity
+#define PERIOD_HEADER_SIZE 16
+// index entry: greatest end (8), offset (8), size (8), smallest start (8)
+#define INDEX_ENTRY_SIZE 32
+
+struct IndexEntry
+{
+    uint64_t last     = 0;
+    uint64_t offset   = 0;
+    uint64_t size     = 0;
+    uint64_t minStart = 0;
+};
+
+static std::string s_activity_file(const char* path, const char* filename)
+{
+    return std::string(path) + "/" + filename + ".activity";
+}
+
+static std::string s_index_file(const char* path, const char* filename)
+{
+    return std::string(path) + "/" + filename + ".activity.index";
+}
+
+// read 'size' bytes of 'fd' at 'offset' to 'data'
+// returns false if not all of them were read
+static bool s_read(int fd, std::string& data, uint64_t offset, size_t size)
+{
+    data.resize(size);
+    size_t done = 0;
+    while (done < size) {
+        ssize_t count = pread(fd, &data[done], size - done, off_t(offset + done));
+        if (count == -1 && errno == EINTR)
+            continue;
+        if (count <= 0)
+            return false;
+        done += size_t(count);
+    }
+    return true;
+}
+
+static void s_put_entry(std::string& index, const IndexEntry& entry)
+{
+    alert_put64(index, entry.last);
+    alert_put64(index, entry.offset);
+    alert_put64(index, entry.size);
+    alert_put64(index, entry.minStart);
+}
+
+static bool s_read_entry(int fd, uint64_t number, IndexEntry& entry)
+{
+    std::string data;
+    if (!s_read(fd, data, number * INDEX_ENTRY_SIZE, INDEX_ENTRY_SIZE))
+        return false;
+    entry.last     = alert_get64(data.data());
+    entry.offset   = alert_get64(data.data() + 8);
+    entry.size     = alert_get64(data.data() + 16);
+    entry.minStart = alert_get64(data.data() + 24);
+    return true;
+}
+
+static uint64_t s_file_size(int fd)
+{
+    struct stat st;
+    return fstat(fd, &st) == 0 ? uint64_t(st.st_size) : 0;
+}
+
+// first of the 'entries' blocks indexed by 'fd' with periods ended at 'from' or later:
+// all periods of the previous ones ended before it
+static uint64_t s_first_block(int fd, uint64_t entries, uint64_t from)
+{
+    IndexEntry entry;
+    uint64_t   low  = 0;
+    uint64_t   high = entries;
+    while (low < high) {
+        uint64_t middle = low + (high - low) / 2;
+        if (s_read_entry(fd, middle, entry) && entry.last < from)
+            low = middle + 1;
+        else
+            high = middle;
+    }
+    return low;
+}
+
+// decode periods of 'data' read at 'offset', calling 'period' for each valid one (with
+// its offset in the log)
+// returns offset following the last valid period
+static uint64_t s_decode(
+    const std::string& data, uint64_t offset, const std::function<bool(AlertActivity&, uint64_t)>& period)
+{
+    size_t position = 0;
+    while (position + RECORD_OVERHEAD <= data.size()) {
+        size_t size = alert_get32(data.data() + position);
+        if (size < PERIOD_HEADER_SIZE + 3 || position + RECORD_OVERHEAD + size > data.size())
+            break;
+        const char* payload = data.data() + position + 4;
+        if (alert_get32(payload + size) != alert_crc32(payload, size) || payload[size - 1] != '\0')
+            break;
+
+        AlertActivity activity;
+        activity.start    = alert_get64(payload);
+        activity.end      = alert_get64(payload + 8);
+        const char* field = payload + PERIOD_HEADER_SIZE;
+        const char* end   = payload + size;
+        for (std::string* value : {&activity.rule, &activity.element, &activity.severity}) {
+            if (field >= end)
+                break;
+            *value = field;
+            field += value->size() + 1;
+        }
+        uint64_t at = offset + position;
+        position += RECORD_OVERHEAD + size;
+        if (!period(activity, at))
+            break;
+    }
+    return offset + position;
+}
+
+// write 'data' to a new file 'file' and sync it
+// 0 - success, -1 - error
+static int s_write_new(const std::string& file, const std::string& data)
+{
+    unlink(file.c_str());
+    int fd = open(file.c_str(), O_WRONLY | O_CREAT | O_EXCL | O_NOFOLLOW | O_CLOEXEC, 0644);
+    if (fd == -1)
+        return -1;
+    int rv = alert_write(fd, data) == 0 && fdatasync(fd) == 0 ? 0 : -1;
+    close(fd);
+    if (rv != 0)
+        unlink(file.c_str());
+    return rv;
+}
+
+int alert_activity_open(AlertActivityLog& log, const char* path, const char* filename)
+{
+    if (!path || !filename) {
+        log_error("cannot open activity log");
+        return -1;
+    }
+    alert_activity_close(log);
+    zsys_dir_create("%s", path);
+    std::string file  = s_activity_file(path, filename);
+    std::string index = s_index_file(path, filename);
+    log.fd            = open(file.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    log.indexFd       = open(index.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    if (log.fd == -1 || log.indexFd == -1) {
+        log_error("cannot open activity log %s: %s", file.c_str(), strerror(errno));
+        alert_activity_close(log);
+        return -1;
+    }
+
+    // complete entries of the index, the block following the last one is being filled
+    uint64_t   entries = s_file_size(log.indexFd) / INDEX_ENTRY_SIZE;
+    uint64_t   size    = s_file_size(log.fd);
+    IndexEntry entry;
+    while (entries > 0 && (!s_read_entry(log.indexFd, entries - 1, entry) || entry.offset + entry.size > size))
+        entries--;
+    log.last          = entries > 0 ? entry.last : 0;
+    log.blockOffset   = entries > 0 ? entry.offset + entry.size : 0;
+    log.blockMinStart = UINT64_MAX;
+    log.blockCount    = 0;
+
+    std::string data;
+    if (!s_read(log.fd, data, log.blockOffset, size_t(size - log.blockOffset))) {
+        log_error("cannot read activity log %s", file.c_str());
+        alert_activity_close(log);
+        return -1;
+    }
+    std::string indexed;
+    log.size = s_decode(data, log.blockOffset, [&](AlertActivity& activity, uint64_t offset) {
+        if (log.blockCount >= ALERT_ACTIVITY_BLOCK) {
+            s_put_entry(indexed, {log.last, log.blockOffset, offset - log.blockOffset, log.blockMinStart});
+            log.blockOffset   = offset;
+            log.blockMinStart = UINT64_MAX;
+            log.blockCount    = 0;
+        }
+        log.last          = std::max(log.last, activity.end);
+        log.blockMinStart = std::min(log.blockMinStart, activity.start);
+        log.blockCount++;
+        return true;
+    });
+    if (log.size != size)
+        log_warning("activity log %s: dropping %" PRIu64 " bytes of incomplete period", file.c_str(), size - log.size);
+
+    // blocks not indexed yet (after a failed index write, or all of them once the index
+    // was removed by alert_activity_expire()) are indexed now,
+    // a block completed just before a crash is indexed by the next append
+    if (ftruncate(log.fd, off_t(log.size)) != 0 || ftruncate(log.indexFd, off_t(entries * INDEX_ENTRY_SIZE)) != 0
+        || lseek(log.fd, 0, SEEK_END) == -1 || lseek(log.indexFd, 0, SEEK_END) == -1
+        || (!indexed.empty() && (alert_write(log.indexFd, indexed) != 0 || fdatasync(log.indexFd) != 0))) {
+        log_error("cannot recover activity log %s: %s", file.c_str(), strerror(errno));
+        alert_activity_close(log);
+        return -1;
+    }
+    alert_sync_dir(path);
+    return 0;
+}
+
+int alert_activity_append(AlertActivityLog& log, const std::vector<AlertActivity>& periods)
+{
+    if (log.fd == -1 || log.indexFd == -1) {
+        log_error("activity log not open");
+        return -1;
+    }
+
+    AlertActivityLog next = log;
+    std::string      data;
+    std::string      index;
+    for (const auto& activity : periods) {
+        // a block grown past its size by a failed index write is indexed as is
+        if (next.blockCount >= ALERT_ACTIVITY_BLOCK) {
+            s_put_entry(
+                index, {next.last, next.blockOffset, next.size + data.size() - next.blockOffset, next.blockMinStart});
+            next.blockOffset   = next.size + data.size();
+            next.blockMinStart = UINT64_MAX;
+            next.blockCount    = 0;
+        }
+
+        std::string period;
+        alert_put64(period, activity.start);
+        alert_put64(period, activity.end);
+        for (const std::string* field : {&activity.rule, &activity.element, &activity.severity}) {
+            period.append(*field);
+            period.push_back('\0');
+        }
+        alert_put32(data, uint32_t(period.size()));
+        data.append(period);
+        alert_put32(data, alert_crc32(period.data(), period.size()));
+
+        next.last          = std::max(next.last, activity.end);
+        next.blockMinStart = std::min(next.blockMinStart, activity.start);
+        next.blockCount++;
+    }
+    next.size += data.size();
+
+    // periods are synced before the index refers to them
+    if (alert_write(log.fd, data) != 0 || fdatasync(log.fd) != 0) {
+        log_error("activity log not written: %s", strerror(errno));
+        if (ftruncate(log.fd, off_t(log.size)) != 0)
+            log_error("activity log: cannot drop incomplete periods");
+        return -1;
+    }
+    off_t indexed = lseek(log.indexFd, 0, SEEK_END);
+    if (index.empty() || (alert_write(log.indexFd, index) == 0 && fdatasync(log.indexFd) == 0)) {
+        log = next;
+        return 0;
+    }
+
+    // periods are kept, in the block being filled
+    log_error("activity log index not written: %s", strerror(errno));
+    if (indexed == -1 || ftruncate(log.indexFd, indexed) != 0)
+        log_error("activity log: cannot drop incomplete index entry");
+    for (const auto& activity : periods)
+        log.blockMinStart = std::min(log.blockMinStart, activity.start);
+    log.blockCount += uint32_t(periods.size());
+    log.size = next.size;
+    log.last = next.last;
+    return -1;
+}
+
+int alert_activity_expire(AlertActivityLog& log, const char* path, const char* filename, uint64_t before)
+{
+    if (log.fd == -1 || log.indexFd == -1 || !path || !filename) {
+        log_error("activity log not open");
+        return -1;
+    }
+
+    // blocks of periods all ended before 'before', dropped once they make half of the log
+    // (so that the periods kept are not copied again at each expiry)
+    uint64_t   entries = s_file_size(log.indexFd) / INDEX_ENTRY_SIZE;
+    uint64_t   expired = s_first_block(log.indexFd, entries, before);
+    IndexEntry entry;
+    if (expired == 0 || !s_read_entry(log.indexFd, expired - 1, entry))
+        return 0;
+    uint64_t cut = entry.offset + entry.size;
+    if (cut * 2 < log.size)
+        return 0;
+
+    // remaining periods and their index, offsets moved to the start of the log
+    std::string data;
+    std::string index;
+    bool        read = s_read(log.fd, data, cut, size_t(log.size - cut));
+    for (uint64_t number = expired; read && number < entries; number++) {
+        read = s_read_entry(log.indexFd, number, entry);
+        entry.offset -= cut;
+        s_put_entry(index, entry);
+    }
+    std::string file      = s_activity_file(path, filename);
+    std::string indexFile = s_index_file(path, filename);
+    if (!read || s_write_new(file + ".tmp", data) != 0 || s_write_new(indexFile + ".tmp", index) != 0) {
+        log_error("activity log %s not expired: %s", file.c_str(), strerror(errno));
+        unlink((file + ".tmp").c_str());
+        return -1;
+    }
+
+    // the index is removed first, so that it never refers to the periods of another log:
+    // after a crash in between, alert_activity_open() indexes the periods again
+    int rv = -1;
+    if (unlink(indexFile.c_str()) == 0 || errno == ENOENT) {
+        alert_sync_dir(path);
+        if (rename((file + ".tmp").c_str(), file.c_str()) == 0
+            && rename((indexFile + ".tmp").c_str(), indexFile.c_str()) == 0) {
+            rv = 0;
+        }
+    }
+    if (rv != 0) {
+        log_error("activity log %s not expired: %s", file.c_str(), strerror(errno));
+        unlink((file + ".tmp").c_str());
+        unlink((indexFile + ".tmp").c_str());
+    }
+    alert_sync_dir(path);
+
+    // the log is open again in any case: whatever the files hold, it recovers them
+    alert_activity_close(log);
+    if (alert_activity_open(log, path, filename) != 0)
+        return -1;
+    if (rv == 0)
+        log_debug("activity log %s: %" PRIu64 " blocks of periods ended before %" PRIu64 " dropped", file.c_str(),
+            expired, before);
+    return rv;
+}
+
+void alert_activity_close(AlertActivityLog& log)
+{
+    if (log.fd != -1)
+        close(log.fd);
+    if (log.indexFd != -1)
+        close(log.indexFd);
+    log.fd      = -1;
+    log.indexFd = -1;
+}
+
+int alert_activity_query(const char* path, const char* filename, uint64_t from, uint64_t to, const char* element,
+    const std::function<bool(const AlertActivity&)>& found)
+{
+    if (!path || !filename || from > to) {
+        log_error("cannot query activity log");
+        return -1;
+    }
+    // index first: one removed meanwhile by alert_activity_expire() may not match the
+    // periods, they are all read instead
+    std::string file    = s_activity_file(path, filename);
+    int         indexFd = open(s_index_file(path, filename).c_str(), O_RDONLY | O_CLOEXEC);
+    int         fd      = open(file.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd == -1) {
+        int error = errno;
+        if (indexFd != -1)
+            close(indexFd);
+        return error == ENOENT ? 0 : -1;
+    }
+    struct stat st;
+    if (indexFd != -1 && (fstat(indexFd, &st) != 0 || st.st_nlink == 0)) {
+        close(indexFd);
+        indexFd = -1;
+    }
+
+    uint64_t size    = s_file_size(fd);
+    uint64_t entries = indexFd == -1 ? 0 : s_file_size(indexFd) / INDEX_ENTRY_SIZE;
+
+    // complete blocks, the one following the last of them is being filled
+    IndexEntry entry;
+    while (entries > 0 && (!s_read_entry(indexFd, entries - 1, entry) || entry.offset + entry.size > size))
+        entries--;
+    uint64_t tail = entries > 0 ? entry.offset + entry.size : 0;
+
+    uint64_t    low   = s_first_block(indexFd, entries, from);
+    int         count = 0;
+    bool        more  = true;
+    std::string data;
+    auto        match = [&](AlertActivity& activity, uint64_t) {
+        if (activity.start <= to && activity.end >= from
+            && (!element || UTF8::utf8eq(activity.element.c_str(), element))) {
+            count++;
+            more = found(activity);
+        }
+        return more;
+    };
+
+    // indexed blocks, those of periods started after the range are not read
+    for (uint64_t number = low; more && number < entries; number++) {
+        if (!s_read_entry(indexFd, number, entry)) {
+            log_warning("activity log %s: cannot read index", file.c_str());
+            break;
+        }
+        if (entry.minStart > to)
+            continue;
+        if (!s_read(fd, data, entry.offset, size_t(entry.size))) {
+            log_warning("activity log %s: cannot read block", file.c_str());
+            break;
+        }
+        s_decode(data, entry.offset, match);
+    }
+
+    // block being filled
+    if (more && tail < size && s_read(fd, data, tail, size_t(size - tail)))
+        s_decode(data, tail, match);
+
+    if (indexFd != -1)
+        close(indexFd);
+    close(fd);
+    return count;
+}
@@ -0,0 +1,93 @@
+/*  =========================================================================
+    alerts_activity - Time indexed log of alert activity periods
+
+    Copyright (C) 2014 - 2020 Eaton
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+    =========================================================================
+*/
+
+
+#pragma once
+
+#include <functional>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+/// Activity log keeps the periods alerts were active (not RESOLVED), appended as they end
+/// (file <state file>.activity), so that they are roughly ordered by end time.
+///
+/// Record: size of the period (uint32_t, little endian), the period: start and end
+/// (uint64_t), rule, element and severity (NUL terminated), and its crc32 (uint32_t).
+///
+/// Records are indexed by blocks of ALERT_ACTIVITY_BLOCK (file <state file>.activity.index),
+/// once a block is complete. Entry: greatest end time of its records and all the previous
+/// ones, its offset and size, and the smallest start time of its records (uint64_t each).
+/// Greatest end times are ordered, a query seeks the first block which may hold periods
+/// ended in its range by binary search, then skips blocks of periods started after it.
+///
+/// Blocks of periods ended before the retention age are dropped as a whole (see
+/// alert_activity_expire()). A missing index is rebuilt from the records.
+
+#define ALERT_ACTIVITY_BLOCK 64
+
+/// activity period of an alert, times in s since the epoch
+struct AlertActivity
+{
+    uint64_t    start = 0;
+    uint64_t    end   = 0; // 0 - still active
+    std::string rule;
+    std::string element;
+    std::string severity;
+};
+
+/// activity log open for appending
+struct AlertActivityLog
+{
+    int      fd      = -1; // records
+    int      indexFd = -1; // index of complete blocks
+    uint64_t size    = 0;  // of the records
+    uint64_t last    = 0;  // greatest end time of the records
+
+    // block being filled, indexed once complete
+    uint64_t blockOffset   = 0;
+    uint64_t blockMinStart = UINT64_MAX;
+    uint32_t blockCount    = 0;
+};
+
+/// open activity log of state file 'filename' for appending, dropping the tail of a write
+/// interrupted by a crash
+/// 0 - success, -1 - error
+int alert_activity_open(AlertActivityLog& log, const char* path, const char* filename);
+
+/// append 'periods' to activity 'log' and sync it
+/// 0 - success, -1 - error
+int alert_activity_append(AlertActivityLog& log, const std::vector<AlertActivity>& periods);
+
+/// drop the indexed blocks of activity 'log' (of state file 'filename') whose periods all
+/// ended before 'before', once they make at least half of the log; the log is rewritten,
+/// then open again
+/// 0 - success (or nothing to drop), -1 - error
+int alert_activity_expire(AlertActivityLog& log, const char* path, const char* filename, uint64_t before);
+
+/// close activity 'log'
+void alert_activity_close(AlertActivityLog& log);
+
+/// call 'found' for each period of the activity log of state file 'filename' which
+/// overlaps ['from', 'to'] (of 'element' only unless NULL), until it returns false
+/// returns number of periods found, -1 on error
+int alert_activity_query(const char* path, const char* filename, uint64_t from, uint64_t to, const char* element,
+    const std::function<bool(const AlertActivity&)>& found);
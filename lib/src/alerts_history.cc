@@ -0,0 +1,362 @@
+/*  =========================================================================
+    alerts_history - History of resolved alerts moved out of the store
+
+    Copyright (C) 2014 - 2020 Eaton
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+    =========================================================================
+ */
+
+
+/*
+@header
+    alerts_history - History of resolved alerts moved out of the store
+@discuss
+@end
+ */
+
+#include "alerts_history.h"
+#include "alerts_io.h"
+#include "alerts_journal.h"
+#include "alerts_utils.h"
+#include <algorithm>
+#include <dirent.h>
+#include <fcntl.h>
+#include <fty_common.h>
+#include <fty_log.h>
+#include <map>
+#include <set>
+#include <string>
+#include <sys/stat.h>
+#include <vector>
+#include <zlib.h>
+
+#define HISTORY_MAGIC   "FTYALRTH"
+#define HISTORY_VERSION 1
+
+// file header: magic (8), version (4)
+#define HEADER_SIZE 12
+// block header: compressed size (4), raw size (4), first time (8), last time (8), crc32 of
+// the data (4), crc32 of the header (4)
+#define BLOCK_HEADER_SIZE 32
+
+// raw data of a block is at most BLOCK_RAW_LIMIT bytes, a move writes several blocks if needed
+#define BLOCK_RAW_LIMIT (16 * 1024 * 1024)
+
+#define SECONDS_PER_DAY 86400
+
+// file of day 'day' (days since the epoch)
+static std::string s_history_file(const char* path, uint64_t day)
+{
+    time_t    time = time_t(day * SECONDS_PER_DAY);
+    struct tm date;
+    char      name[32];
+    gmtime_r(&time, &date);
+    strftime(name, sizeof(name), "history.%Y%m%d", &date);
+    return std::string(path) + "/" + name;
+}
+
+// days of the history files in 'path', in ascending order
+static std::vector<uint64_t> s_history_days(const char* path)
+{
+    std::vector<uint64_t> days;
+    DIR*                  dir = opendir(path);
+    if (!dir)
+        return days;
+    while (struct dirent* entry = readdir(dir)) {
+        struct tm date;
+        memset(&date, 0, sizeof(date));
+        const char* end = strncmp(entry->d_name, "history.", 8) == 0 ? strptime(entry->d_name + 8, "%Y%m%d", &date)
+                                                                      : nullptr;
+        if (end && *end == '\0')
+            days.push_back(uint64_t(timegm(&date)) / SECONDS_PER_DAY);
+    }
+    closedir(dir);
+    std::sort(days.begin(), days.end());
+    return days;
+}
+
+struct BlockHeader
+{
+    uint32_t size  = 0; // compressed
+    uint32_t raw   = 0;
+    uint64_t first = 0;
+    uint64_t last  = 0;
+    uint32_t crc   = 0; // of the compressed data
+};
+
+// decode block header 'data', followed by 'remaining' bytes of the file
+// (sizes are checked before anything is allocated from them)
+// 0 - success, -1 - corrupted (the blocks following it cannot be found)
+static int s_block_header(const char* data, uint64_t remaining, BlockHeader& block)
+{
+    if (alert_get32(data + 28) != alert_crc32(data, 28))
+        return -1;
+    block.size  = alert_get32(data);
+    block.raw   = alert_get32(data + 4);
+    block.first = alert_get64(data + 8);
+    block.last  = alert_get64(data + 16);
+    block.crc   = alert_get32(data + 24);
+    if (block.raw > BLOCK_RAW_LIMIT || block.size > compressBound(block.raw) || block.size > remaining)
+        return -1;
+    return 0;
+}
+
+// encode header of 'block'
+static void s_put_block_header(std::string& buffer, const BlockHeader& block)
+{
+    size_t start = buffer.size();
+    alert_put32(buffer, block.size);
+    alert_put32(buffer, block.raw);
+    alert_put64(buffer, block.first);
+    alert_put64(buffer, block.last);
+    alert_put32(buffer, block.crc);
+    alert_put32(buffer, alert_crc32(buffer.data() + start, 28));
+}
+
+// size of the complete blocks of file 'fd' of 'size' bytes (what follows is the tail of
+// a write interrupted by a crash), 0 if it has no valid header
+static off_t s_valid_size(int fd, off_t size)
+{
+    char header[BLOCK_HEADER_SIZE];
+    if (size < HEADER_SIZE || pread(fd, header, HEADER_SIZE, 0) != HEADER_SIZE
+        || memcmp(header, HISTORY_MAGIC, 8) != 0 || alert_get32(header + 8) != HISTORY_VERSION) {
+        return 0;
+    }
+
+    off_t       offset = HEADER_SIZE;
+    BlockHeader block;
+    while (offset + BLOCK_HEADER_SIZE <= size && pread(fd, header, BLOCK_HEADER_SIZE, offset) == BLOCK_HEADER_SIZE
+           && s_block_header(header, uint64_t(size - offset) - BLOCK_HEADER_SIZE, block) == 0) {
+        offset += BLOCK_HEADER_SIZE + off_t(block.size);
+    }
+    return offset;
+}
+
+// append 'block' to file of day 'day'
+// 0 - success, -1 - error
+static int s_append_block(const char* path, uint64_t day, const std::string& block)
+{
+    std::string file = s_history_file(path, day);
+    int         fd   = open(file.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    if (fd == -1) {
+        log_error("cannot open history %s: %s", file.c_str(), strerror(errno));
+        return -1;
+    }
+
+    struct stat st;
+    off_t       size  = fstat(fd, &st) == 0 ? st.st_size : 0;
+    off_t       valid = s_valid_size(fd, size);
+    std::string data;
+    if (valid == 0) {
+        if (size > 0)
+            log_warning("history %s: bad header, file started again", file.c_str());
+        data.append(HISTORY_MAGIC, 8);
+        alert_put32(data, HISTORY_VERSION);
+    } else if (valid != size) {
+        log_warning("history %s: dropping %" PRIi64 " bytes of incomplete block", file.c_str(), int64_t(size - valid));
+    }
+    data.append(block);
+
+    int rv = -1;
+    if (ftruncate(fd, valid) == 0 && lseek(fd, valid, SEEK_SET) == valid && alert_write(fd, data) == 0
+        && fdatasync(fd) == 0) {
+        rv = 0;
+    } else {
+        log_error("history %s not written: %s", file.c_str(), strerror(errno));
+        if (ftruncate(fd, valid) != 0)
+            log_error("history %s: cannot drop incomplete block", file.c_str());
+    }
+    close(fd);
+    if (rv == 0 && size == 0)
+        alert_sync_dir(path);
+    return rv;
+}
+
+int alert_history_append(const char* path, zlistx_t* alerts)
+{
+    if (!path || !alerts) {
+        log_error("cannot append to history");
+        return -1;
+    }
+    zsys_dir_create("%s", path);
+
+    // raw blocks, by day (a day gets a new block once the last one is full)
+    struct Block
+    {
+        std::string raw;
+        uint64_t    first = UINT64_MAX;
+        uint64_t    last  = 0;
+    };
+    std::map<uint64_t, std::vector<Block>> blocks;
+
+    fty_proto_t* cursor = reinterpret_cast<fty_proto_t*>(zlistx_first(alerts));
+    while (cursor) {
+        std::string encoded = alert_encode_frame(cursor);
+        if (!encoded.empty() && encoded.size() + 4 <= BLOCK_RAW_LIMIT) {
+            uint64_t            time = fty_proto_time(cursor);
+            std::vector<Block>& day  = blocks[time / SECONDS_PER_DAY];
+            if (day.empty() || day.back().raw.size() + 4 + encoded.size() > BLOCK_RAW_LIMIT)
+                day.emplace_back();
+            Block& block = day.back();
+            alert_put32(block.raw, uint32_t(encoded.size()));
+            block.raw.append(encoded);
+            block.first = std::min(block.first, time);
+            block.last  = std::max(block.last, time);
+        }
+        cursor = reinterpret_cast<fty_proto_t*>(zlistx_next(alerts));
+    }
+
+    for (const auto& it : blocks) {
+        std::string data;
+        for (const Block& block : it.second) {
+            uLongf      size = compressBound(uLong(block.raw.size()));
+            std::string compressed(size, '\0');
+            if (compress2(reinterpret_cast<Bytef*>(&compressed[0]), &size,
+                    reinterpret_cast<const Bytef*>(block.raw.data()), uLong(block.raw.size()), Z_DEFAULT_COMPRESSION)
+                != Z_OK) {
+                log_error("history block not compressed");
+                return -1;
+            }
+            compressed.resize(size);
+
+            BlockHeader header;
+            header.size  = uint32_t(compressed.size());
+            header.raw   = uint32_t(block.raw.size());
+            header.first = block.first;
+            header.last  = block.last;
+            header.crc   = alert_crc32(compressed.data(), compressed.size());
+            s_put_block_header(data, header);
+            data.append(compressed);
+        }
+        if (s_append_block(path, it.first, data) != 0)
+            return -1;
+    }
+    return 0;
+}
+
+// call 'found' for the alerts of block 'raw' matching the query, skipping those in 'seen'
+// returns false once 'found' returned false
+static bool s_query_block(const std::string& raw, uint64_t from, uint64_t to, const char* element,
+    const std::function<bool(fty_proto_t*)>& found, std::set<std::string>& seen, int& count)
+{
+    size_t offset = 0;
+    while (offset + 4 <= raw.size()) {
+        size_t size = alert_get32(raw.data() + offset);
+        offset += 4;
+        if (offset + size > raw.size())
+            break;
+        fty_proto_t* alert = alert_decode_frame(raw.data() + offset, size);
+        offset += size;
+        if (!alert)
+            continue;
+
+        uint64_t time = fty_proto_time(alert);
+        bool     more = true;
+        if (time >= from && time <= to && (!element || UTF8::utf8eq(fty_proto_name(alert), element))) {
+            // an alert moved twice (its removal from the store did not complete) is listed once
+            std::string key = std::string(fty_proto_rule(alert)) + '\0' + fty_proto_name(alert) + '\0'
+                              + std::to_string(time);
+            if (seen.insert(key).second) {
+                count++;
+                more = found(alert);
+            }
+        }
+        fty_proto_destroy(&alert);
+        if (!more)
+            return false;
+    }
+    return true;
+}
+
+int alert_history_query(const char* path, uint64_t from, uint64_t to, const char* element,
+    const std::function<bool(fty_proto_t*)>& found)
+{
+    if (!path || from > to) {
+        log_error("cannot query history");
+        return -1;
+    }
+
+    int                   count = 0;
+    bool                  more  = true;
+    std::set<std::string> seen;
+    for (uint64_t day : s_history_days(path)) {
+        if (!more)
+            break;
+        if (day < from / SECONDS_PER_DAY || day > to / SECONDS_PER_DAY)
+            continue;
+        std::string file   = s_history_file(path, day);
+        FILE*       handle = fopen(file.c_str(), "rb");
+        if (!handle)
+            continue;
+        struct stat st;
+        uint64_t    size = fstat(fileno(handle), &st) == 0 ? uint64_t(st.st_size) : 0;
+
+        char header[BLOCK_HEADER_SIZE];
+        bool valid = fread(header, 1, HEADER_SIZE, handle) == HEADER_SIZE && memcmp(header, HISTORY_MAGIC, 8) == 0
+                     && alert_get32(header + 8) == HISTORY_VERSION;
+        if (!valid)
+            log_warning("history %s: bad header", file.c_str());
+        uint64_t    offset = HEADER_SIZE;
+        BlockHeader block;
+        while (valid && more && fread(header, 1, BLOCK_HEADER_SIZE, handle) == BLOCK_HEADER_SIZE) {
+            offset += BLOCK_HEADER_SIZE;
+            if (s_block_header(header, size - std::min(size, offset), block) != 0) {
+                log_warning("history %s: ignoring corrupted block header and what follows", file.c_str());
+                break;
+            }
+            // blocks out of the range are skipped without reading them
+            offset += block.size;
+            if (block.last < from || block.first > to) {
+                if (fseek(handle, long(block.size), SEEK_CUR) != 0)
+                    break;
+                continue;
+            }
+
+            std::string compressed(block.size, '\0');
+            if (fread(&compressed[0], 1, block.size, handle) != block.size) {
+                log_warning("history %s: ignoring incomplete block", file.c_str());
+                break;
+            }
+            uLongf      raw = block.raw;
+            std::string data(block.raw, '\0');
+            if (block.crc != alert_crc32(compressed.data(), compressed.size())
+                || uncompress(reinterpret_cast<Bytef*>(&data[0]), &raw,
+                       reinterpret_cast<const Bytef*>(compressed.data()), uLong(compressed.size()))
+                       != Z_OK
+                || raw != block.raw) {
+                log_warning("history %s: ignoring corrupted block", file.c_str());
+                continue;
+            }
+            more = s_query_block(data, from, to, element, found, seen, count);
+        }
+        fclose(handle);
+    }
+    return count;
+}
+
+int alert_history_query(
+    const char* path, uint64_t from, uint64_t to, const char* element, zlistx_t* alerts, size_t limit)
+{
+    if (!alerts) {
+        log_error("cannot query history");
+        return -1;
+    }
+    size_t added = 0;
+    return alert_history_query(path, from, to, element, [&](fty_proto_t* alert) {
+        zlistx_add_end(alerts, alert);
+        return !limit || ++added < limit;
+    });
+}
@@ -0,0 +1,55 @@
+/*  =========================================================================
+    alerts_history - History of resolved alerts moved out of the store
+
+    Copyright (C) 2014 - 2020 Eaton
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+    =========================================================================
+*/
+
+
+#pragma once
+
+#include <czmq.h>
+#include <functional>
+#include <fty_proto.h>
+
+/// History keeps resolved alerts moved out of the store, on disk only. It is partitioned
+/// by day of the alert time (UTC), one file per day: history.<YYYYMMDD>.
+///
+/// File: magic "FTYALRTH" and version (uint32_t, little endian), then blocks appended by
+/// each move. Block: compressed size, raw size (uint32_t), time of its first and last alert
+/// (uint64_t), crc32 of the compressed data and crc32 of the previous fields of the header
+/// (uint32_t), then the data compressed by deflate. Raw data (at most 16 MiB per block):
+/// for each alert, its size (uint32_t) and the alert (fty_proto message encoded in one
+/// frame).
+
+/// append 'alerts' to the history in directory 'path' (created if needed), synced
+/// 0 - success, -1 - error
+int alert_history_append(const char* path, zlistx_t* alerts);
+
+/// call 'found' for each alert of the history in directory 'path' with time in ['from', 'to']
+/// (of 'element' only unless NULL), until it returns false (the alert is destroyed once it
+/// returned)
+/// returns number of alerts found, -1 on error
+int alert_history_query(const char* path, uint64_t from, uint64_t to, const char* element,
+    const std::function<bool(fty_proto_t*)>& found);
+
+/// add copies of alerts of the history in directory 'path' with time in ['from', 'to']
+/// (of 'element' only unless NULL) to 'alerts', at most 'limit' of them (0 - no limit)
+/// ('alerts' must duplicate added items, as for alert_load_state())
+/// returns number of alerts added, -1 on error
+int alert_history_query(
+    const char* path, uint64_t from, uint64_t to, const char* element, zlistx_t* alerts, size_t limit = 0);
@@ -0,0 +1,106 @@
+/*  =========================================================================
+    alerts_ingest - Ingest queue of deliveries waiting for processing
+
+    Copyright (C) 2014 - 2020 Eaton
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+    =========================================================================
+ */
+
+
+/*
+@header
+    alerts_ingest - Ingest queue of deliveries waiting for processing
+@discuss
+@end
+ */
+
+#include "alerts_ingest.h"
+
+// take the first delivery of 'chain' into 'entry', the chain is dropped once empty
+static void s_take_first(
+    AlertIngestQueue& queue, decltype(AlertIngestQueue::chains)::iterator chain, AlertIngestEntry& entry)
+{
+    entry = std::move(chain->second.front());
+    chain->second.pop_front();
+    queue.size--;
+    if (chain->second.empty()) {
+        queue.byKey.erase(entry.key);
+        queue.chains.erase(chain);
+    }
+}
+
+void alert_ingest_push(AlertIngestQueue& queue, int lane, AlertIngestEntry&& entry)
+{
+    auto queued = queue.byKey.find(entry.key);
+    if (queued == queue.byKey.end()) {
+        auto pos = std::make_pair(lane, queue.seq++);
+        queue.byKey.emplace(entry.key, pos);
+        queue.chains[pos].push_back(std::move(entry));
+        queue.size++;
+        return;
+    }
+
+    auto              chain = queue.chains.find(queued->second);
+    AlertIngestEntry& last  = chain->second.back();
+    if (streq(fty_proto_state(last.alert), fty_proto_state(entry.alert))
+        && streq(fty_proto_severity(last.alert), fty_proto_severity(entry.alert))) {
+        // unchanged refresh supersedes the last queued delivery, at its place
+        fty_proto_destroy(&last.alert);
+        last = std::move(entry);
+    } else {
+        chain->second.push_back(std::move(entry));
+        queue.size++;
+    }
+
+    // the chain moves up to the best lane of its deliveries, keeping its arrival
+    if (lane < chain->first.first) {
+        auto                         pos        = std::make_pair(lane, chain->first.second);
+        std::deque<AlertIngestEntry> deliveries = std::move(chain->second);
+        queue.chains.erase(chain);
+        queue.chains.emplace(pos, std::move(deliveries));
+        queued->second = pos;
+    }
+}
+
+bool alert_ingest_pop(AlertIngestQueue& queue, AlertIngestEntry& entry)
+{
+    if (queue.chains.empty())
+        return false;
+
+    s_take_first(queue, queue.chains.begin(), entry);
+    return true;
+}
+
+bool alert_ingest_take(AlertIngestQueue& queue, const std::string& key, AlertIngestEntry& entry)
+{
+    auto queued = queue.byKey.find(key);
+    if (queued == queue.byKey.end())
+        return false;
+
+    s_take_first(queue, queue.chains.find(queued->second), entry);
+    return true;
+}
+
+void alert_ingest_clear(AlertIngestQueue& queue)
+{
+    for (auto& chain : queue.chains) {
+        for (auto& entry : chain.second)
+            fty_proto_destroy(&entry.alert);
+    }
+    queue.chains.clear();
+    queue.byKey.clear();
+    queue.size = 0;
+}
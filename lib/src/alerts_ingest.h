@@ -0,0 +1,71 @@
+/*  =========================================================================
+    alerts_ingest - Ingest queue of deliveries waiting for processing
+
+    Copyright (C) 2014 - 2020 Eaton
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+    =========================================================================
+*/
+
+
+#pragma once
+
+#include <deque>
+#include <fty_proto.h>
+#include <map>
+#include <string>
+#include <unordered_map>
+
+/// Ingest queue holds deliveries pulled ahead of processing, in lanes taken by priority
+/// (by arrival within a lane). Deliveries of one alert (same key) are chained in their
+/// order, the chain takes the best lane of its deliveries and keeps the position of the
+/// first one, so that each alert is applied in order and no state change is lost. Only an
+/// unchanged refresh (same state and severity as the last queued delivery) replaces it.
+
+/// ingest lanes, in processing order
+#define ALERT_LANE_CRITICAL 0 // CRITICAL severity
+#define ALERT_LANE_CHANGE   1 // new alerts, state or severity changes
+#define ALERT_LANE_REFRESH  2 // unchanged refreshes
+
+/// delivery waiting for processing
+struct AlertIngestEntry
+{
+    std::string  subject;
+    std::string  key;             // identifier of the alert, see alert_id_key()
+    fty_proto_t* alert = nullptr; // owned by the queue while queued
+};
+
+struct AlertIngestQueue
+{
+    std::map<std::pair<int, uint64_t>, std::deque<AlertIngestEntry>> chains; // by (lane, arrival)
+    std::unordered_map<std::string, std::pair<int, uint64_t>>        byKey;
+    uint64_t                                                         seq  = 0;
+    size_t                                                           size = 0; // queued deliveries
+};
+
+/// queue 'entry' in 'lane' after the queued deliveries of the same alert, replacing (and
+/// destroying) the last of them if 'entry' is an unchanged refresh of it
+void alert_ingest_push(AlertIngestQueue& queue, int lane, AlertIngestEntry&& entry);
+
+/// take the first delivery of the most important lane into 'entry'
+/// false if the queue is empty
+bool alert_ingest_pop(AlertIngestQueue& queue, AlertIngestEntry& entry);
+
+/// take the first queued delivery of the alert of 'key' into 'entry'
+/// false if there is none
+bool alert_ingest_take(AlertIngestQueue& queue, const std::string& key, AlertIngestEntry& entry);
+
+/// destroy all queued deliveries
+void alert_ingest_clear(AlertIngestQueue& queue);
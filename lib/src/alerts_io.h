@@ -0,0 +1,92 @@
+/*  =========================================================================
+    alerts_io - Binary encoding helpers shared by the files of the alert store
+
+    Copyright (C) 2014 - 2020 Eaton
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+    =========================================================================
+*/
+
+
+#pragma once
+
+#include <climits>
+#include <errno.h>
+#include <stdint.h>
+#include <string>
+#include <unistd.h>
+#include <zlib.h>
+
+/// Internal to the library: state file, journal, acknowledgement log, history and activity
+/// log store their integers little endian and protect their records by crc32.
+
+/// append 'value' to 'buffer', little endian
+inline void alert_put32(std::string& buffer, uint32_t value)
+{
+    for (int i = 0; i < 4; i++)
+        buffer.push_back(char((value >> (8 * i)) & 0xFF));
+}
+
+inline void alert_put64(std::string& buffer, uint64_t value)
+{
+    for (int i = 0; i < 8; i++)
+        buffer.push_back(char((value >> (8 * i)) & 0xFF));
+}
+
+/// little endian integer at 'data'
+inline uint32_t alert_get32(const char* data)
+{
+    uint32_t value = 0;
+    for (int i = 0; i < 4; i++)
+        value |= uint32_t(uint8_t(data[i])) << (8 * i);
+    return value;
+}
+
+inline uint64_t alert_get64(const char* data)
+{
+    uint64_t value = 0;
+    for (int i = 0; i < 8; i++)
+        value |= uint64_t(uint8_t(data[i])) << (8 * i);
+    return value;
+}
+
+/// write all of 'data' to 'fd' (at its offset, retried on EINTR and short writes)
+/// 0 - success, -1 - error
+inline int alert_write(int fd, const std::string& data)
+{
+    size_t offset = 0;
+    while (offset < data.size()) {
+        ssize_t written = write(fd, data.data() + offset, data.size() - offset);
+        if (written == -1 && errno == EINTR)
+            continue;
+        if (written == -1)
+            return -1;
+        offset += size_t(written);
+    }
+    return 0;
+}
+
+/// crc32 (IEEE 802.3) of 'size' bytes of 'data', continuing 'crc' (by zlib)
+inline uint32_t alert_crc32(const void* data, size_t size, uint32_t crc = 0)
+{
+    const Bytef* bytes = reinterpret_cast<const Bytef*>(data);
+    while (size > 0) {
+        uInt chunk = size > UINT_MAX ? UINT_MAX : uInt(size);
+        crc        = uint32_t(crc32(crc, bytes, chunk));
+        bytes += chunk;
+        size -= chunk;
+    }
+    return crc;
+}
@@ -0,0 +1,365 @@
+/*  =========================================================================
+    alerts_journal - Journal of alert store mutations
+
+    Copyright (C) 2014 - 2020 Eaton
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+    =========================================================================
+ */
+
+
+/*
+@header
+    alerts_journal - Journal of alert store mutations
+@discuss
+@end
+ */
+
+#include "alerts_journal.h"
+#include "alerts_io.h"
+#include "alerts_utils.h"
+#include <algorithm>
+#include <dirent.h>
+#include <fcntl.h>
+#include <functional>
+#include <fty_log.h>
+#include <unordered_map>
+
+// record framing: size (4), mutation (1), alert (size), crc32 (4)
+#define RECORD_OVERHEAD 9
+
+static std::string s_journal_file(const char* path, const char* filename, uint64_t generation)
+{
+    return std::string(path) + "/" + filename + ".journal." + std::to_string(generation);
+}
+
+// alerts by case folded rule and element (see alert_id_key(), several alerts may share one)
+using ReplayIndex = std::unordered_multimap<std::string, void*>;
+
+static void s_journal_apply(zlistx_t* alerts, ReplayIndex& index, uint8_t op, fty_proto_t* alert)
+{
+    std::string key   = alert_id_key(fty_proto_rule(alert), fty_proto_name(alert));
+    auto        range = index.equal_range(key);
+    for (auto it = range.first; it != range.second; ++it) {
+        fty_proto_t* stored = reinterpret_cast<fty_proto_t*>(zlistx_handle_item(it->second));
+        if (is_alert_identified(stored, fty_proto_rule(alert), fty_proto_name(alert))) {
+            zlistx_delete(alerts, it->second);
+            index.erase(it);
+            break;
+        }
+    }
+    if (op != ALERT_JOURNAL_PURGE)
+        index.emplace(key, zlistx_add_end(alerts, alert));
+}
+
+// read the records of 'file' (a journal generation or the acknowledgement log), stops
+// at the first incomplete or corrupted record (the tail of a write interrupted by a crash)
+// returns false if the file cannot be read
+static bool s_read_records(
+    const std::string& file, const std::function<void(uint8_t op, const char* data, size_t size)>& apply)
+{
+    FILE* handle = fopen(file.c_str(), "rb");
+    if (!handle) {
+        log_error("cannot open journal %s", file.c_str());
+        return false;
+    }
+    std::string data;
+    char        buffer[65536];
+    size_t      nbytes;
+    while ((nbytes = fread(buffer, 1, sizeof(buffer), handle)) > 0)
+        data.append(buffer, nbytes);
+    fclose(handle);
+
+    size_t offset = 0;
+    while (offset + RECORD_OVERHEAD <= data.size()) {
+        size_t size = alert_get32(data.data() + offset);
+        if (offset + RECORD_OVERHEAD + size > data.size())
+            break;
+        if (alert_get32(data.data() + offset + 5 + size) != alert_crc32(data.data() + offset + 4, size + 1))
+            break;
+        apply(uint8_t(data[offset + 4]), data.data() + offset + 5, size);
+        offset += RECORD_OVERHEAD + size;
+    }
+    if (offset != data.size())
+        log_warning("journal %s: ignoring %zu bytes of incomplete record", file.c_str(), data.size() - offset);
+    return true;
+}
+
+// replay one journal generation
+// returns number of records applied, -1 on error
+static int s_journal_replay_file(zlistx_t* alerts, ReplayIndex& index, const std::string& file)
+{
+    int  count = 0;
+    bool read  = s_read_records(file, [&](uint8_t op, const char* data, size_t size) {
+        fty_proto_t* alert = alert_decode_frame(data, size);
+        if (!alert) {
+            log_warning("Ignoring malformed alert in %s", file.c_str());
+            return;
+        }
+        s_journal_apply(alerts, index, op, alert);
+        fty_proto_destroy(&alert);
+        count++;
+    });
+    return read ? count : -1;
+}
+
+// index of 'alerts' by case folded rule and element
+static ReplayIndex s_replay_index(zlistx_t* alerts)
+{
+    ReplayIndex  index;
+    fty_proto_t* cursor = reinterpret_cast<fty_proto_t*>(zlistx_first(alerts));
+    while (cursor) {
+        index.emplace(alert_id_key(fty_proto_rule(cursor), fty_proto_name(cursor)), zlistx_cursor(alerts));
+        cursor = reinterpret_cast<fty_proto_t*>(zlistx_next(alerts));
+    }
+    return index;
+}
+
+std::vector<uint64_t> alert_journal_generations(const char* path, const char* filename)
+{
+    std::vector<uint64_t> generations;
+    if (!path || !filename)
+        return generations;
+
+    DIR* dir = opendir(path);
+    if (!dir)
+        return generations;
+
+    std::string prefix = std::string(filename) + ".journal.";
+    while (struct dirent* entry = readdir(dir)) {
+        if (strncmp(entry->d_name, prefix.c_str(), prefix.size()) != 0)
+            continue;
+        const char* suffix     = entry->d_name + prefix.size();
+        char*       end        = nullptr;
+        uint64_t    generation = strtoull(suffix, &end, 10);
+        if (*suffix && end && *end == '\0')
+            generations.push_back(generation);
+    }
+    closedir(dir);
+
+    std::sort(generations.begin(), generations.end());
+    return generations;
+}
+
+int alert_journal_open(const char* path, const char* filename, uint64_t generation)
+{
+    std::string file = s_journal_file(path, filename, generation);
+    int         fd   = open(file.c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+    if (fd == -1) {
+        log_error("cannot open journal %s: %s", file.c_str(), strerror(errno));
+        return -1;
+    }
+    alert_sync_dir(path);
+    return fd;
+}
+
+void alert_journal_record(std::string& batch, uint8_t op, const void* data, size_t size)
+{
+    size_t start = batch.size();
+    alert_put32(batch, uint32_t(size));
+    batch.push_back(char(op));
+    batch.append(reinterpret_cast<const char*>(data), size);
+    alert_put32(batch, alert_crc32(batch.data() + start + 4, size + 1));
+}
+
+int alert_journal_write(int fd, const std::string& batch)
+{
+    size_t offset = 0;
+    while (offset < batch.size()) {
+        ssize_t written = write(fd, batch.data() + offset, batch.size() - offset);
+        if (written == -1 && errno == EINTR)
+            continue;
+        if (written == -1) {
+            log_error("journal write failed: %s", strerror(errno));
+            return -1;
+        }
+        offset += size_t(written);
+    }
+    if (fdatasync(fd) == -1) {
+        log_error("journal sync failed: %s", strerror(errno));
+        return -1;
+    }
+    return 0;
+}
+
+int alert_journal_replay(zlistx_t* alerts, const char* path, const char* filename, uint64_t last)
+{
+    if (!alerts || !path || !filename) {
+        log_error("cannot replay journal");
+        return -1;
+    }
+
+    std::vector<uint64_t> generations = alert_journal_generations(path, filename);
+    if (generations.empty())
+        return 0;
+
+    ReplayIndex index = s_replay_index(alerts);
+    int         count = 0;
+    for (uint64_t generation : generations) {
+        if (generation > last)
+            break;
+        std::string file = s_journal_file(path, filename, generation);
+        int         rv   = s_journal_replay_file(alerts, index, file);
+        log_debug("replayed %d records of journal %s", rv, file.c_str());
+        if (rv > 0)
+            count += rv;
+    }
+    return count;
+}
+
+void alert_journal_remove(const char* path, const char* filename, uint64_t generation)
+{
+    bool removed = false;
+    for (uint64_t older : alert_journal_generations(path, filename)) {
+        if (older >= generation)
+            break;
+        std::string file = s_journal_file(path, filename, older);
+        if (unlink(file.c_str()) == -1)
+            log_warning("cannot remove journal %s: %s", file.c_str(), strerror(errno));
+        else
+            removed = true;
+    }
+    if (removed)
+        alert_sync_dir(path);
+}
+
+static std::string s_ack_log_file(const char* path, const char* filename)
+{
+    return std::string(path) + "/" + filename + ".acks";
+}
+
+int alert_ack_log_open(const char* path, const char* filename)
+{
+    std::string file = s_ack_log_file(path, filename);
+    int         fd   = open(file.c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+    if (fd == -1) {
+        log_error("cannot open acknowledgement log %s: %s", file.c_str(), strerror(errno));
+        return -1;
+    }
+    alert_sync_dir(path);
+    return fd;
+}
+
+void alert_ack_log_record(
+    std::string& batch, const char* rule, const char* element, const char* state, uint64_t time)
+{
+    // time (8), then rule, element and state, each NUL terminated
+    std::string ack;
+    for (int i = 0; i < 8; i++)
+        ack.push_back(char((time >> (8 * i)) & 0xFF));
+    for (const char* field : {rule, element, state}) {
+        ack.append(field ? field : "");
+        ack.push_back('\0');
+    }
+    alert_journal_record(batch, ALERT_JOURNAL_ACK, ack.data(), ack.size());
+}
+
+int alert_ack_log_replay(zlistx_t* alerts, const char* path, const char* filename)
+{
+    if (!alerts || !path || !filename) {
+        log_error("cannot replay acknowledgement log");
+        return -1;
+    }
+    std::string file = s_ack_log_file(path, filename);
+    if (!zsys_file_exists(file.c_str()))
+        return 0;
+
+    ReplayIndex index = s_replay_index(alerts);
+    int         count = 0;
+    bool        read  = s_read_records(file, [&](uint8_t op, const char* data, size_t size) {
+        std::vector<const char*> fields;
+        if (op == ALERT_JOURNAL_ACK && size > 8 && data[size - 1] == '\0') {
+            for (size_t offset = 8; offset < size; offset += strlen(data + offset) + 1)
+                fields.push_back(data + offset);
+        }
+        if (fields.size() != 3) {
+            log_warning("Ignoring malformed acknowledgement in %s", file.c_str());
+            return;
+        }
+        uint64_t time = 0;
+        for (int i = 0; i < 8; i++)
+            time |= uint64_t(uint8_t(data[i])) << (8 * i);
+
+        // an acknowledgement stands while the alert is not resolved or raised again since
+        auto range = index.equal_range(alert_id_key(fields[0], fields[1]));
+        for (auto it = range.first; it != range.second; ++it) {
+            fty_proto_t* stored = reinterpret_cast<fty_proto_t*>(zlistx_handle_item(it->second));
+            if (is_alert_identified(stored, fields[0], fields[1])) {
+                if (fty_proto_time(stored) == time && !streq(fty_proto_state(stored), "RESOLVED")) {
+                    fty_proto_set_state(stored, "%s", fields[2]);
+                    count++;
+                }
+                break;
+            }
+        }
+    });
+    log_debug("replayed %d acknowledgements of %s", count, file.c_str());
+    return read ? count : -1;
+}
+
+void alert_ack_log_remove(const char* path, const char* filename)
+{
+    std::string file = s_ack_log_file(path, filename);
+    if (unlink(file.c_str()) == 0)
+        alert_sync_dir(path);
+}
+
+std::string alert_encode_frame(fty_proto_t* alert)
+{
+    std::string  encoded;
+    fty_proto_t* duplicate = fty_proto_dup(alert);
+    zmsg_t*      result    = fty_proto_encode(&duplicate);
+    if (!result)
+        return encoded;
+
+    /* Note: the CZMQ_VERSION_MAJOR comparison below actually assumes versions
+     * we know and care about - v3.0.2 (our legacy default, already obsoleted
+     * by upstream), and v4.x that is in current upstream master. If the API
+     * evolves later (incompatibly), these macros will need to be amended.
+     */
+#if CZMQ_VERSION_MAJOR == 3
+    byte*  buffer = NULL;
+    size_t nbytes = zmsg_encode(result, &buffer);
+    encoded.assign(reinterpret_cast<char*>(buffer), nbytes);
+    free(buffer);
+    buffer = NULL;
+#else
+    zframe_t* frame = zmsg_encode(result);
+    assert(frame);
+    encoded.assign(reinterpret_cast<char*>(zframe_data(frame)), zframe_size(frame));
+    zframe_destroy(&frame);
+#endif
+    zmsg_destroy(&result);
+    return encoded;
+}
+
+fty_proto_t* alert_decode_frame(const void* data, size_t size)
+{
+    zmsg_t* msg = NULL;
+#if CZMQ_VERSION_MAJOR == 3
+    msg = zmsg_decode(reinterpret_cast<byte*>(const_cast<void*>(data)), size);
+#else
+    {
+        zframe_t* frame = zframe_new(data, size);
+        msg             = zmsg_decode(frame);
+        zframe_destroy(&frame);
+    }
+#endif
+    if (!msg || !fty_proto_is(msg)) {
+        zmsg_destroy(&msg);
+        return NULL;
+    }
+    return fty_proto_decode(&msg);
+}
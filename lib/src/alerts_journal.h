@@ -0,0 +1,93 @@
+/*  =========================================================================
+    alerts_journal - Journal of alert store mutations
+
+    Copyright (C) 2014 - 2020 Eaton
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+    =========================================================================
+*/
+
+
+#pragma once
+
+#include <czmq.h>
+#include <fty_proto.h>
+#include <string>
+#include <vector>
+
+/// Journal records mutations of the alert store between two saves of the state file.
+/// It is split in generations (files <state file>.journal.<generation>), a new one is
+/// started by each checkpoint which removes the older ones once the state file is saved.
+///
+/// Record: size of the alert (uint32_t, little endian), mutation (uint8_t), the alert
+/// (fty_proto message encoded in one frame) and crc32 of mutation and alert (uint32_t).
+
+/// mutations of the alert store
+#define ALERT_JOURNAL_CREATE  1
+#define ALERT_JOURNAL_UPDATE  2
+#define ALERT_JOURNAL_ACK     3
+#define ALERT_JOURNAL_RESOLVE 4
+#define ALERT_JOURNAL_PURGE   5
+
+/// journal generations of state file 'filename', in ascending order
+std::vector<uint64_t> alert_journal_generations(const char* path, const char* filename);
+
+/// open journal generation 'generation' of state file 'filename' for appending
+/// returns file descriptor, -1 on error
+int alert_journal_open(const char* path, const char* filename, uint64_t generation);
+
+/// append record of mutation 'op' of an alert encoded in 'size' bytes of 'data' to 'batch'
+void alert_journal_record(std::string& batch, uint8_t op, const void* data, size_t size);
+
+/// write 'batch' of records to journal 'fd' and sync it (one sync for the whole batch)
+/// 0 - success, -1 - error
+int alert_journal_write(int fd, const std::string& batch);
+
+/// replay journal generations of state file 'filename', up to 'last', onto the loaded 'alerts'
+/// ('alerts' must duplicate added items, as for alert_load_state())
+/// returns number of records applied, -1 on error
+int alert_journal_replay(zlistx_t* alerts, const char* path, const char* filename, uint64_t last = UINT64_MAX);
+
+/// remove journal generations of state file 'filename' older than 'generation'
+void alert_journal_remove(const char* path, const char* filename, uint64_t generation);
+
+/// Acknowledgement log keeps acknowledgements made durable before they are confirmed, so
+/// that none is lost until the state file is saved (file <state file>.acks). Records are
+/// framed as in the journal, with mutation ALERT_JOURNAL_ACK and the acknowledgement: time
+/// of the alert (uint64_t, little endian), rule, element and new state (NUL terminated).
+
+/// open acknowledgement log of state file 'filename' for appending
+/// returns file descriptor, -1 on error
+int alert_ack_log_open(const char* path, const char* filename);
+
+/// append record of acknowledgement of alert ('rule', 'element') raised at 'time' to 'state'
+/// to 'batch' (written as journal batches, see alert_journal_write())
+void alert_ack_log_record(
+    std::string& batch, const char* rule, const char* element, const char* state, uint64_t time);
+
+/// replay acknowledgement log of state file 'filename' onto the loaded 'alerts'
+/// (an acknowledgement applies while its alert is not resolved nor raised again since)
+/// returns number of records applied, -1 on error
+int alert_ack_log_replay(zlistx_t* alerts, const char* path, const char* filename);
+
+/// remove acknowledgement log of state file 'filename'
+void alert_ack_log_remove(const char* path, const char* filename);
+
+/// encode 'alert' in one frame, as sent in rfc-alerts-list replies
+std::string alert_encode_frame(fty_proto_t* alert);
+
+/// decode alert encoded in 'size' bytes of 'data' (see alert_encode_frame())
+/// returns NULL on error
+fty_proto_t* alert_decode_frame(const void* data, size_t size);
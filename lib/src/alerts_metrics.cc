@@ -0,0 +1,77 @@
+/*  =========================================================================
+    alerts_metrics - Internal metrics of the agent
+
+    Copyright (C) 2014 - 2020 Eaton
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+    =========================================================================
+ */
+
+
+/*
+@header
+    alerts_metrics - Internal metrics of the agent
+@discuss
+@end
+ */
+
+#include "alerts_metrics.h"
+#include <math.h>
+
+// bucket of 'value': its count of significant bits
+static size_t s_bucket(uint64_t value)
+{
+    size_t bits = 0;
+    while (value) {
+        bits++;
+        value >>= 1;
+    }
+    return bits < ALERT_HISTOGRAM_BUCKETS ? bits : ALERT_HISTOGRAM_BUCKETS - 1;
+}
+
+void alert_histogram_record(AlertHistogram& histogram, uint64_t value)
+{
+    histogram.buckets[s_bucket(value)].fetch_add(1, std::memory_order_relaxed);
+    histogram.count.fetch_add(1, std::memory_order_relaxed);
+    histogram.sum.fetch_add(value, std::memory_order_relaxed);
+
+    uint64_t max = histogram.max.load(std::memory_order_relaxed);
+    while (value > max && !histogram.max.compare_exchange_weak(max, value, std::memory_order_relaxed))
+        ;
+}
+
+uint64_t alert_histogram_quantile(const AlertHistogram& histogram, double quantile)
+{
+    // buckets are read one by one, their total may differ from count meanwhile
+    uint64_t total = 0;
+    for (const auto& bucket : histogram.buckets)
+        total += bucket.load(std::memory_order_relaxed);
+    if (total == 0)
+        return 0;
+
+    uint64_t rank = uint64_t(ceil(quantile * double(total)));
+    if (rank == 0)
+        rank = 1;
+    uint64_t max  = histogram.max.load(std::memory_order_relaxed);
+    uint64_t seen = 0;
+    for (size_t i = 0; i < ALERT_HISTOGRAM_BUCKETS - 1; i++) {
+        seen += histogram.buckets[i].load(std::memory_order_relaxed);
+        if (seen >= rank) {
+            uint64_t upper = (uint64_t(1) << i) - 1;
+            return upper < max ? upper : max;
+        }
+    }
+    return max;
+}
@@ -0,0 +1,53 @@
+/*  =========================================================================
+    alerts_metrics - Internal metrics of the agent
+
+    Copyright (C) 2014 - 2020 Eaton
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+    =========================================================================
+*/
+
+
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <stdint.h>
+
+/// Metrics are updated by several actors without locking: counters and histograms are
+/// made of atomics only, updated with relaxed ordering (they are statistics, a reader may
+/// see some of them a little older than others).
+
+/// bucket i counts the values of i significant bits (bucket 0 - value 0), the last one
+/// all greater values as well
+#define ALERT_HISTOGRAM_BUCKETS 40
+
+/// histogram of values (latencies in us), by powers of 2
+struct AlertHistogram
+{
+    std::array<std::atomic<uint64_t>, ALERT_HISTOGRAM_BUCKETS> buckets {};
+
+    std::atomic<uint64_t> count {0};
+    std::atomic<uint64_t> sum {0};
+    std::atomic<uint64_t> max {0};
+};
+
+/// add 'value' to 'histogram'
+void alert_histogram_record(AlertHistogram& histogram, uint64_t value);
+
+/// upper bound of the values of 'histogram' below quantile 'quantile' (in [0, 1]), as
+/// the greatest value of the bucket holding it (at most the greatest value recorded)
+/// returns 0 if no value was recorded
+uint64_t alert_histogram_quantile(const AlertHistogram& histogram, double quantile);
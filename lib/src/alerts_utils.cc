@@ -27,9 +27,19 @@
  */
 
 #include "alerts_utils.h"
+#include "alerts_io.h"
+#include "alerts_journal.h"
+#include <algorithm>
+#include <fcntl.h>
 #include <fty_common.h>
 #include <fty_log.h>
 #include <string>
+#include <string_view>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <unordered_map>
+#include <vector>
 
 // encode a c-string S (z85 encoding)
 // returns the encoded buffer (c-string)
@@ -221,25 +231,431 @@ int is_acknowledge_request_state(const char* state)
     return 0;
 }
 
-// 0 - ok, -1 - error
+// loaded alerts by identifier key, so that duplicates are found in constant time
+using LoadedAlerts = std::unordered_multimap<std::string, fty_proto_t*>;
 
-static int s_alerts_input_checks(zlistx_t* alerts, fty_proto_t* alert)
+// case folded element (ASCII only, other characters are left out so that all elements
+// equal for UTF8::utf8eq() share a key)
+std::string alert_element_key(const char* element)
 {
-    assert(alerts);
-    assert(alert);
+    std::string key;
+    for (const char* c = element; c && *c; c++) {
+        if (static_cast<unsigned char>(*c) < 0x80)
+            key.push_back(char(tolower(static_cast<unsigned char>(*c))));
+    }
+    return key;
+}
+
+// case folded rule and element (see alert_element_key())
+std::string alert_id_key(const char* rule, const char* element)
+{
+    std::string key;
+    for (const char* c = rule; c && *c; c++)
+        key.push_back(char(tolower(static_cast<unsigned char>(*c))));
+    key.push_back('\0');
+    key.append(alert_element_key(element));
+    return key;
+}
+
+// key of the identifier of 'alert'
+static std::string s_alert_key(fty_proto_t* alert)
+{
+    return alert_id_key(fty_proto_rule(alert), fty_proto_name(alert));
+}
 
+// index of the alerts already in 'alerts'
+static LoadedAlerts s_loaded_alerts(zlistx_t* alerts)
+{
+    LoadedAlerts loaded;
     fty_proto_t* cursor = reinterpret_cast<fty_proto_t*>(zlistx_first(alerts));
     while (cursor) {
-        if (alert_id_comparator(cursor, alert) == 0) {
+        loaded.emplace(s_alert_key(cursor), cursor);
+        cursor = reinterpret_cast<fty_proto_t*>(zlistx_next(alerts));
+    }
+    return loaded;
+}
+
+// 0 - ok, -1 - error
+
+static int s_alerts_input_checks(const LoadedAlerts& loaded, fty_proto_t* alert)
+{
+    assert(alert);
+
+    auto range = loaded.equal_range(s_alert_key(alert));
+    for (auto it = range.first; it != range.second; ++it) {
+        if (alert_id_comparator(it->second, alert) == 0) {
             // We already have 'alert' in zlistx 'alerts'
             return -1;
         }
-        cursor = reinterpret_cast<fty_proto_t*>(zlistx_next(alerts));
     }
 
     return 0;
 }
 
+// add loaded 'alert' to 'alerts' and index it, whether the list duplicates it or takes
+// it over
+static void s_alerts_add(zlistx_t* alerts, LoadedAlerts& loaded, fty_proto_t* alert)
+{
+    void*        handle = zlistx_add_end(alerts, alert);
+    fty_proto_t* item   = reinterpret_cast<fty_proto_t*>(zlistx_handle_item(handle));
+    loaded.emplace(s_alert_key(item), item);
+    if (item != alert)
+        fty_proto_destroy(&alert);
+}
+
+// binary state file
+//
+// header: magic (8), version (4), number of strings (4), number of records (4),
+// crc32 of the previous fields (4)
+// string table: each string as length (4) and bytes, then crc32 of the table (4)
+// records: each as size (4), fields (size) and crc32 of the fields (4)
+// record fields: time (8), ttl (4), rule, element, state, severity, description and
+// metadata (string indexes, 4 each), number of actions (4) and their string indexes,
+// number of aux items (4) and their key and value string indexes
+//
+// all integers are little endian; strings repeated across alerts (rules, elements,
+// states, actions, ...) are stored once
+#define STATE_MAGIC       "FTYALRTS"
+#define STATE_MAGIC_SIZE  8
+#define STATE_VERSION     1
+#define STATE_HEADER_SIZE 24
+
+// bounds checked reader of a binary state file
+struct StateReader
+{
+    const uint8_t* data;
+    size_t         size;
+    size_t         offset = 0;
+    bool           ok     = true;
+
+    StateReader(const void* d, size_t s)
+        : data(reinterpret_cast<const uint8_t*>(d))
+        , size(s)
+    {
+    }
+
+    bool has(size_t n) const
+    {
+        return ok && n <= size - offset;
+    }
+
+    uint64_t get(int bytes)
+    {
+        if (!has(size_t(bytes))) {
+            ok = false;
+            return 0;
+        }
+        uint64_t value = 0;
+        for (int i = 0; i < bytes; i++)
+            value |= uint64_t(data[offset + size_t(i)]) << (8 * i);
+        offset += size_t(bytes);
+        return value;
+    }
+
+    uint32_t get32()
+    {
+        return uint32_t(get(4));
+    }
+
+    uint64_t get64()
+    {
+        return get(8);
+    }
+};
+
+// add 's' to the string table of 'state' (strings are indexed in order of first use)
+static uint32_t s_state_string(AlertState& state, const char* s)
+{
+    std::string str(s ? s : "");
+    auto        it = state.index.find(str);
+    if (it != state.index.end())
+        return it->second;
+    uint32_t id = uint32_t(state.index.size());
+    state.index.emplace(str, id);
+    alert_put32(state.strings, uint32_t(str.size()));
+    state.strings.append(str);
+    return id;
+}
+
+void alert_state_add(AlertState& state, fty_proto_t* alert)
+{
+    std::string fields;
+    alert_put64(fields, fty_proto_time(alert));
+    alert_put32(fields, fty_proto_ttl(alert));
+    alert_put32(fields, s_state_string(state, fty_proto_rule(alert)));
+    alert_put32(fields, s_state_string(state, fty_proto_name(alert)));
+    alert_put32(fields, s_state_string(state, fty_proto_state(alert)));
+    alert_put32(fields, s_state_string(state, fty_proto_severity(alert)));
+    alert_put32(fields, s_state_string(state, fty_proto_description(alert)));
+    alert_put32(fields, s_state_string(state, fty_proto_metadata(alert)));
+
+    alert_put32(fields, uint32_t(fty_proto_action_size(alert)));
+    for (const char* action = fty_proto_action_first(alert); action; action = fty_proto_action_next(alert))
+        alert_put32(fields, s_state_string(state, action));
+
+    zhash_t* aux = fty_proto_aux(alert);
+    alert_put32(fields, aux ? uint32_t(zhash_size(aux)) : 0);
+    if (aux) {
+        for (void* value = zhash_first(aux); value; value = zhash_next(aux)) {
+            alert_put32(fields, s_state_string(state, zhash_cursor(aux)));
+            alert_put32(fields, s_state_string(state, reinterpret_cast<const char*>(value)));
+        }
+    }
+
+    alert_put32(state.records, uint32_t(fields.size()));
+    state.records.append(fields);
+    alert_put32(state.records, alert_crc32(fields.data(), fields.size()));
+    state.count++;
+}
+
+int alert_state_save(const AlertState& state, const char* path, const char* filename, mode_t mode)
+{
+    if (!path || !filename) {
+        log_error("cannot save state");
+        return -1;
+    }
+
+    std::string header(STATE_MAGIC, STATE_MAGIC_SIZE);
+    alert_put32(header, STATE_VERSION);
+    alert_put32(header, uint32_t(state.index.size()));
+    alert_put32(header, state.count);
+    alert_put32(header, alert_crc32(header.data(), header.size()));
+    std::string table_crc;
+    alert_put32(table_crc, alert_crc32(state.strings.data(), state.strings.size()));
+
+    // the new state file replaces the previous one atomically once it is complete and
+    // synced, so a crash at any point leaves one of them whole
+    // ('path' may be shared: the temporary file is created anew, never through a link)
+    std::string state_file = std::string(path) + "/" + filename;
+    std::string temp_file  = state_file + ".tmp";
+    unlink(temp_file.c_str());
+    int fd = open(temp_file.c_str(), O_WRONLY | O_CREAT | O_EXCL | O_NOFOLLOW | O_CLOEXEC, mode);
+    if (fd == -1) {
+        log_error("cannot open state file %s: %s", temp_file.c_str(), strerror(errno));
+        return -1;
+    }
+    bool written = alert_write(fd, header) == 0 && alert_write(fd, state.strings) == 0 && alert_write(fd, table_crc) == 0
+                   && alert_write(fd, state.records) == 0 && fsync(fd) == 0;
+    if (close(fd) != 0 || !written) {
+        log_error("cannot write state file %s: %s", temp_file.c_str(), strerror(errno));
+        unlink(temp_file.c_str());
+        return -1;
+    }
+    if (rename(temp_file.c_str(), state_file.c_str()) == -1) {
+        log_error("cannot replace state file %s: %s", state_file.c_str(), strerror(errno));
+        unlink(temp_file.c_str());
+        return -1;
+    }
+    alert_sync_dir(path);
+    return 0;
+}
+
+// decode record 'fields' referencing 'strings' (views of the string table)
+// returns NULL if the record is malformed
+static fty_proto_t* s_state_alert(StateReader fields, const std::vector<std::string_view>& strings)
+{
+    static const std::string_view none;
+    auto string = [&](uint32_t id) -> const std::string_view& {
+        if (id >= strings.size()) {
+            fields.ok = false;
+            return none;
+        }
+        return strings[id];
+    };
+
+    fty_proto_t* alert = fty_proto_new(FTY_PROTO_ALERT);
+    if (!alert)
+        return NULL;
+    fty_proto_set_time(alert, fields.get64());
+    fty_proto_set_ttl(alert, fields.get32());
+    // strings are copied straight from the table, which is not NUL terminated
+    const std::string_view* field;
+    field = &string(fields.get32());
+    fty_proto_set_rule(alert, "%.*s", int(field->size()), field->data());
+    field = &string(fields.get32());
+    fty_proto_set_name(alert, "%.*s", int(field->size()), field->data());
+    field = &string(fields.get32());
+    fty_proto_set_state(alert, "%.*s", int(field->size()), field->data());
+    field = &string(fields.get32());
+    fty_proto_set_severity(alert, "%.*s", int(field->size()), field->data());
+    field = &string(fields.get32());
+    fty_proto_set_description(alert, "%.*s", int(field->size()), field->data());
+    field = &string(fields.get32());
+    fty_proto_set_metadata(alert, "%.*s", int(field->size()), field->data());
+
+    uint32_t actions = fields.get32();
+    if (fields.has(size_t(actions) * 4)) {
+        zlist_t* list = zlist_new();
+        zlist_autofree(list);
+        for (uint32_t i = 0; i < actions; i++)
+            zlist_append(list, const_cast<char*>(std::string(string(fields.get32())).c_str()));
+        fty_proto_set_action(alert, &list);
+        zlist_destroy(&list);
+    }
+
+    uint32_t aux = fields.get32();
+    for (uint32_t i = 0; i < aux && fields.has(8); i++) {
+        std::string             key(string(fields.get32()));
+        const std::string_view& value = string(fields.get32());
+        fty_proto_aux_insert(alert, key.c_str(), "%.*s", int(value.size()), value.data());
+    }
+
+    if (!fields.has(0) || fields.offset != fields.size)
+        fty_proto_destroy(&alert);
+    return alert;
+}
+
+// load alert state from binary state file 'data'
+// 0 - success, -1 - error, 1 - not a binary state file
+static int s_alert_load_state_binary(zlistx_t* alerts, const void* data, size_t size, const char* state_file)
+{
+    if (size < STATE_HEADER_SIZE || memcmp(data, STATE_MAGIC, STATE_MAGIC_SIZE) != 0)
+        return 1;
+
+    StateReader reader(data, size);
+    reader.offset    = STATE_MAGIC_SIZE;
+    uint32_t version = reader.get32();
+    uint32_t count   = reader.get32();
+    uint32_t records = reader.get32();
+    if (reader.get32() != alert_crc32(data, STATE_HEADER_SIZE - 4)) {
+        log_error("corrupted header in state file %s", state_file);
+        return -1;
+    }
+    if (version != STATE_VERSION) {
+        log_error("unsupported version %" PRIu32 " of state file %s", version, state_file);
+        return -1;
+    }
+
+    std::vector<std::string_view> strings;
+    strings.reserve(std::min(size_t(count), size / 4));
+    size_t table = reader.offset;
+    for (uint32_t i = 0; i < count && reader.ok; i++) {
+        uint32_t length = reader.get32();
+        if (!reader.has(length)) {
+            reader.ok = false;
+            break;
+        }
+        strings.emplace_back(reinterpret_cast<const char*>(reader.data + reader.offset), length);
+        reader.offset += length;
+    }
+    size_t table_size = reader.offset - table;
+    if (!reader.ok || reader.get32() != alert_crc32(reader.data + table, table_size) || !reader.ok) {
+        log_error("corrupted string table in state file %s", state_file);
+        return -1;
+    }
+
+    // check the framing of all records first, so that a damaged file loads nothing
+    StateReader check = reader;
+    for (uint32_t i = 0; i < records && check.ok; i++) {
+        uint32_t record = check.get32();
+        if (check.has(size_t(record) + 4))
+            check.offset += size_t(record) + 4;
+        else
+            check.ok = false;
+    }
+    if (!check.ok || check.offset != check.size) {
+        log_error("damaged state file %s (%s)", state_file, check.ok ? "trailing data" : "truncated");
+        return -1;
+    }
+
+    log_debug("loading %" PRIu32 " alerts from file %s", records, state_file);
+    LoadedAlerts loaded = s_loaded_alerts(alerts);
+    loaded.reserve(loaded.size() + records);
+    for (uint32_t i = 0; i < records; i++) {
+        uint32_t record = reader.get32();
+        StateReader fields(reader.data + reader.offset, record);
+        reader.offset += record;
+        if (reader.get32() != alert_crc32(fields.data, fields.size)) {
+            log_warning("Ignoring corrupted alert in %s", state_file);
+            continue;
+        }
+
+        fty_proto_t* alert = s_state_alert(fields, strings);
+        if (!alert) {
+            log_warning("Ignoring malformed alert in %s", state_file);
+            continue;
+        }
+        if (s_alerts_input_checks(loaded, alert)) {
+            log_warning("Alert id (%s, %s) already read.", fty_proto_rule(alert), fty_proto_name(alert));
+            fty_proto_destroy(&alert);
+        } else {
+            s_alerts_add(alerts, loaded, alert);
+        }
+    }
+    return 0;
+}
+
+// load alert state from binary state file 'state_file' opened as 'fd', mapped in memory
+// (the string table is used in place, no copy of the file is made)
+// 0 - success, -1 - error, 1 - not a (readable) binary state file
+static int s_alert_load_state_fd(zlistx_t* alerts, int fd, const char* state_file)
+{
+    struct stat st;
+    if (fstat(fd, &st) == -1 || !S_ISREG(st.st_mode) || st.st_size == 0)
+        return 1;
+
+    size_t size = size_t(st.st_size);
+    void*  data = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (data == MAP_FAILED) {
+        log_error("cannot map state file %s: %s", state_file, strerror(errno));
+        return -1;
+    }
+    madvise(data, size, MADV_SEQUENTIAL);
+
+    int rv = s_alert_load_state_binary(alerts, data, size, state_file);
+    munmap(data, size);
+    return rv;
+}
+
+// load alert state from binary state file 'path'/'filename'
+// 0 - success, -1 - error, 1 - not a (readable) binary state file
+static int s_alert_load_state_mapped(zlistx_t* alerts, const char* path, const char* filename)
+{
+    std::string state_file = std::string(path) + "/" + filename;
+    int         fd         = open(state_file.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd == -1) {
+        log_debug("cannot open state file %s: %s", state_file.c_str(), strerror(errno));
+        return 1;
+    }
+    int rv = s_alert_load_state_fd(alerts, fd, state_file.c_str());
+    close(fd);
+    return rv;
+}
+
+int alert_load_handoff(
+    zlistx_t* alerts, const char* shared, const char* handoff, const char* path, const char* filename)
+{
+    if (!alerts || !shared || !handoff || !path || !filename) {
+        log_error("cannot load state handoff");
+        return -1;
+    }
+
+    std::string handoff_file = std::string(shared) + "/" + handoff;
+    int         fd           = open(handoff_file.c_str(), O_RDONLY | O_NOFOLLOW | O_CLOEXEC);
+    if (fd == -1)
+        return 1;
+
+    // 'shared' may be writable by anyone, the file is checked once opened
+    struct stat st, saved;
+    if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode) || st.st_uid != geteuid() || (st.st_mode & 07777) != 0600) {
+        log_warning("ignoring state handoff %s, not private to this user", handoff_file.c_str());
+        close(fd);
+        return 1;
+    }
+    // saved on the last stop, after the state file
+    if (stat((std::string(path) + "/" + filename).c_str(), &saved) != 0 || st.st_mtim.tv_sec < saved.st_mtim.tv_sec
+        || (st.st_mtim.tv_sec == saved.st_mtim.tv_sec && st.st_mtim.tv_nsec < saved.st_mtim.tv_nsec)) {
+        log_info("ignoring stale state handoff %s", handoff_file.c_str());
+        close(fd);
+        return 1;
+    }
+
+    log_info("loading alerts from %s ...", handoff_file.c_str());
+    int rv = s_alert_load_state_fd(alerts, fd, handoff_file.c_str());
+    close(fd);
+    return rv == 0 ? 0 : -1;
+}
+
 // load alert state from disk - legacy
 // 0 - success, -1 - error
 static int s_alert_load_state_legacy(zlistx_t* alerts, const char* path, const char* filename)
@@ -261,9 +677,9 @@ static int s_alert_load_state_legacy(zlistx_t* alerts, const char* path, const c
         return -1;
     }
     if (zfile_input(file) == -1) {
+        log_error("zfile_input () failed; filename = '%s'", zfile_filename(file, NULL));
         zfile_close(file);
         zfile_destroy(&file);
-        log_error("zfile_input () failed; filename = '%s'", zfile_filename(file, NULL));
         return -1;
     }
 
@@ -275,59 +691,56 @@ static int s_alert_load_state_legacy(zlistx_t* alerts, const char* path, const c
         return 0;
     }
 
-    zchunk_t* chunk = zchunk_read(zfile_handle(file), size_t(cursize));
-    assert(chunk);
-    zframe_t* frame = zframe_new(zchunk_data(chunk), zchunk_size(chunk));
-    assert(frame);
-    zchunk_destroy(&chunk);
-
-    zfile_close(file);
-    zfile_destroy(&file);
-
     /* Note: Protocol data uses 8-byte sized words, and zmsg_XXcode and file
      * functions deal with platform-dependent unsigned size_t and signed off_t.
      * The off_t is a difficult one to print portably, SO suggests casting to
      * the intmax type and printing that :)
      * https://stackoverflow.com/questions/586928/how-should-i-print-types-like-off-t-and-size-t
      */
-    off_t offset = 0;
-    log_debug("zfile_cursize == %jd", cursize);
-
-    while (offset < cursize) {
-        byte* prefix = zframe_data(frame) + offset;
-        byte* data   = zframe_data(frame) + offset + sizeof(uint64_t);
-        offset += off_t(uint64_t(*prefix) + sizeof(uint64_t));
-
-        /* Note: the CZMQ_VERSION_MAJOR comparison below actually assumes versions
-         * we know and care about - v3.0.2 (our legacy default, already obsoleted
-         * by upstream), and v4.x that is in current upstream master. If the API
-         * evolves later (incompatibly), these macros will need to be amended.
-         */
-        zmsg_t* zmessage = NULL;
-#if CZMQ_VERSION_MAJOR == 3
-        zmessage = zmsg_decode(data, size_t(*prefix));
-#else
-        {
-            zframe_t* fr = zframe_new(data, size_t(*prefix));
-            zmessage     = zmsg_decode(fr);
-            zframe_destroy(&fr);
+    log_debug("zfile_cursize == %jd", intmax_t(cursize));
+
+    // records are read one at a time into the same buffer: 64-bit size (little endian)
+    // then the alert, encoded as a zmsg
+    FILE*        handle = zfile_handle(file);
+    uint64_t     offset = 0;
+    std::string  record;
+    LoadedAlerts loaded = s_loaded_alerts(alerts);
+    while (offset < uint64_t(cursize)) {
+        uint8_t prefix[sizeof(uint64_t)];
+        if (fread(prefix, 1, sizeof(prefix), handle) != sizeof(prefix)) {
+            log_warning("Ignoring truncated alert at offset %" PRIu64 " in %s/%s", offset, path, filename);
+            break;
+        }
+        uint64_t size = 0;
+        for (size_t i = 0; i < sizeof(prefix); i++)
+            size |= uint64_t(prefix[i]) << (8 * i);
+        offset += sizeof(prefix);
+        if (size > uint64_t(cursize) - offset) {
+            log_warning("Ignoring alert of %" PRIu64 " bytes past the end of %s/%s", size, path, filename);
+            break;
         }
-#endif
-        assert(zmessage);
-        fty_proto_t* alert = fty_proto_decode(&zmessage); // zmessage destroyed
+        record.resize(size_t(size));
+        if (fread(&record[0], 1, record.size(), handle) != record.size()) {
+            log_warning("Ignoring truncated alert at offset %" PRIu64 " in %s/%s", offset, path, filename);
+            break;
+        }
+        offset += size;
+
+        fty_proto_t* alert = alert_decode_frame(record.data(), record.size());
         if (!alert) {
             log_warning("Ignoring malformed alert in %s/%s", path, filename);
             continue;
         }
-        if (s_alerts_input_checks(alerts, alert) == 0) {
-            zlistx_add_end(alerts, alert);
+        if (s_alerts_input_checks(loaded, alert) == 0) {
+            s_alerts_add(alerts, loaded, alert);
         } else {
             log_warning("Alert id (%s, %s) already read.", fty_proto_rule(alert), fty_proto_name(alert));
+            fty_proto_destroy(&alert);
         }
-        fty_proto_destroy(&alert);
     }
 
-    zframe_destroy(&frame);
+    zfile_close(file);
+    zfile_destroy(&file);
     return 0;
 }
 
@@ -375,6 +788,7 @@ static int s_alert_load_state_new(zlistx_t* alerts, const char* path, const char
     }
 
     log_debug("loading alerts from file %s", state_file);
+    LoadedAlerts loaded = s_loaded_alerts(alerts);
     while (cursor) {
         fty_proto_t* alert = fty_proto_new_zpl(cursor);
         if (!alert) {
@@ -396,10 +810,11 @@ static int s_alert_load_state_new(zlistx_t* alerts, const char* path, const char
 
         fty_proto_print(alert);
 
-        if (s_alerts_input_checks(alerts, alert)) {
+        if (s_alerts_input_checks(loaded, alert)) {
             log_warning("Alert id (%s, %s) already read.", fty_proto_rule(alert), fty_proto_name(alert));
+            fty_proto_destroy(&alert);
         } else {
-            zlistx_add_end(alerts, alert);
+            s_alerts_add(alerts, loaded, alert);
         }
 
         cursor = zconfig_next(cursor);
@@ -410,6 +825,15 @@ static int s_alert_load_state_new(zlistx_t* alerts, const char* path, const char
     return 0;
 }
 
+void alert_sync_dir(const char* path)
+{
+    int fd = open(path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (fd == -1)
+        return;
+    fsync(fd);
+    close(fd);
+}
+
 int alert_load_state(zlistx_t* alerts, const char* path, const char* filename)
 {
     log_info("loading alerts from %s/%s ...", path, filename);
@@ -419,7 +843,12 @@ int alert_load_state(zlistx_t* alerts, const char* path, const char* filename)
         return -1;
     }
 
-    int rv = s_alert_load_state_new(alerts, path, filename);
+    // binary state file (see alert_save_state()), ZPL and legacy ones are still read
+    int rv = s_alert_load_state_mapped(alerts, path, filename);
+    if (rv != 1)
+        return rv;
+
+    rv = s_alert_load_state_new(alerts, path, filename);
     if (rv != 0) {
         log_warning("s_alert_load_state_new() failed (rv: %d)", rv);
         log_info("retry using s_alert_load_state_legacy()...");
@@ -433,7 +862,7 @@ int alert_load_state(zlistx_t* alerts, const char* path, const char* filename)
     return rv;
 }
 
-// save alert state to disk
+// save alert state to disk (binary state file)
 // 0 - success, -1 - error
 int alert_save_state(zlistx_t* alerts, const char* path, const char* filename, bool /*verbose*/)
 {
@@ -444,40 +873,13 @@ int alert_save_state(zlistx_t* alerts, const char* path, const char* filename, b
         return -1;
     }
 
-    zconfig_t*   state  = zconfig_new("root", NULL);
+    AlertState   state;
     fty_proto_t* cursor = reinterpret_cast<fty_proto_t*>(zlistx_first(alerts));
-
     while (cursor) {
-        fty_proto_print(cursor);
-
-        // encode -complex- attributes of alert,
-        // typically/mostly those who are json payloads or non ascii
-        // *needed* due to zconfig_save()/zconfig_chunk_load() weakness
-        {
-            char* encoded;
-            encoded = s_string_encode(fty_proto_description(cursor));
-            fty_proto_set_description(cursor, "%s", encoded);
-            zstr_free(&encoded);
-            encoded = s_string_encode(fty_proto_metadata(cursor));
-            fty_proto_set_metadata(cursor, "%s", encoded);
-            zstr_free(&encoded);
-        }
-
-        fty_proto_zpl(cursor, state);
+        alert_state_add(state, cursor);
         cursor = reinterpret_cast<fty_proto_t*>(zlistx_next(alerts));
     }
-
-    char* state_file = zsys_sprintf("%s/%s", path, filename);
-    int   rv         = zconfig_save(state, state_file);
-    if (rv == -1) {
-        zstr_free(&state_file);
-        zconfig_destroy(&state);
-        return rv;
-    }
-
-    zstr_free(&state_file);
-    zconfig_destroy(&state);
-    return 0;
+    return alert_state_save(state, path, filename);
 }
 
 fty_proto_t* alert_new(const char* rule, const char* element, const char* state, const char* severity,
@@ -23,6 +23,9 @@
 
 #include <czmq.h>
 #include <fty_proto.h>
+#include <string>
+#include <sys/types.h>
+#include <unordered_map>
 
 #define ACTION_EMAIL "EMAIL"
 #define ACTION_SMS   "SMS"
@@ -35,6 +38,33 @@ int alert_load_state(zlistx_t* alerts, const char* path, const char* filename);
 /// 0 - success, -1 - error
 int alert_save_state(zlistx_t* alerts, const char* path, const char* filename, bool verbose);
 
+/// state file being built one alert at a time, see alert_state_add() and alert_state_save()
+/// (it only reads the added alerts, which may be copies taken from a snapshot of the store)
+struct AlertState
+{
+    std::unordered_map<std::string, uint32_t> index;   // string table index
+    std::string                               strings; // string table
+    std::string                               records;
+    uint32_t                                  count = 0;
+};
+
+/// add 'alert' to state file 'state'
+void alert_state_add(AlertState& state, fty_proto_t* alert);
+
+/// save state file 'state' to disk as 'filename', with permissions 'mode'
+/// 0 - success, -1 - error
+int alert_state_save(const AlertState& state, const char* path, const char* filename, mode_t mode = 0644);
+
+/// load state handed off as 'shared'/'handoff' instead of state file 'path'/'filename'
+/// (binary state file only); it is used only if it is a regular file private to this user
+/// (owned by the effective user, mode 0600) saved after the state file
+/// 0 - success, -1 - error, 1 - no usable handoff
+int alert_load_handoff(
+    zlistx_t* alerts, const char* shared, const char* handoff, const char* path, const char* filename);
+
+/// make creation, replacement or removal of files in 'path' durable
+void alert_sync_dir(const char* path);
+
 /// create new alert
 /// returns new alert on success, NULL on failure
 fty_proto_t* alert_new(const char* rule, const char* element, const char* state, const char* severity,
@@ -48,6 +78,14 @@ int alert_id_comparator(fty_proto_t* alert1, fty_proto_t* alert2);
 /// 1 - Yes, 0 - No
 int is_alert_identified(fty_proto_t* alert, const char* rule_name, const char* element_name);
 
+/// key of alert identifier ('rule_name', 'element_name'): equal for all alerts identified
+/// by it (see is_alert_identified()), seldom equal for other ones
+std::string alert_id_key(const char* rule_name, const char* element_name);
+
+/// key of 'element_name': equal for all element names equal for UTF8::utf8eq(), seldom
+/// equal for other ones
+std::string alert_element_key(const char* element_name);
+
 /// czmq_comparator of two alerts
 /// 0 - same, 1 - different
 int alert_comparator(fty_proto_t* alert1, fty_proto_t* alert2);
@@ -22,158 +22,950 @@
 /// fty_alert_list_server - Providing information about active alerts
 
 #include "fty_alert_list_server.h"
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <deque>
 #include <map>
-#include <mutex>
+#include <memory>
+#include <set>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
 #include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
 #include <fty_proto.h>
 #include <fty_log.h>
 #include <fty_common.h>
 #include <malamute.h>
+#include "alerts_activity.h"
+#include "alerts_history.h"
+#include "alerts_ingest.h"
+#include "alerts_journal.h"
+#include "alerts_metrics.h"
 #include "alerts_utils.h"
 
 #define RFC_ALERTS_LIST_SUBJECT        "rfc-alerts-list"
 #define RFC_ALERTS_ACKNOWLEDGE_SUBJECT "rfc-alerts-acknowledge"
+#define RFC_ALERTS_HISTORY_SUBJECT     "rfc-alerts-history"
+#define RFC_ALERTS_TRANSITIONS_SUBJECT "rfc-alerts-transitions"
+#define RFC_ALERTS_ACTIVITY_SUBJECT    "rfc-alerts-activity"
+#define RFC_ALERTS_METRICS_SUBJECT     "rfc-alerts-metrics"
 
 static const char* STATE_PATH = "/var/lib/fty/fty-alert-list";
 static const char* STATE_FILE = "state_file";
 
-static zlistx_t*                      alerts = nullptr;
-static std::map<fty_proto_t*, time_t> alertsLastSent;
-static std::mutex                     alertMtx;
-static bool                           verbose = false;
+// state file given to init_alert_private(), the journal, acknowledgement and activity logs
+// and the history are kept next to it
+static std::string statePath = STATE_PATH;
+static std::string stateFile = STATE_FILE;
 
-static void s_set_alert_lifetime(zhash_t* exp, fty_proto_t* msg)
+// resolved alerts moved out of the store are kept in statePath/HISTORY_DIR (see alerts_history.h)
+static const char* HISTORY_DIR = "history";
+
+// resolved alerts of the history are answered in messages of at most HISTORY_CHUNK alerts
+#define HISTORY_CHUNK 100
+
+// activity periods are answered in messages of at most ACTIVITY_CHUNK periods
+#define ACTIVITY_CHUNK 500
+
+// on a clean stop, the state may also be handed off to the next process in shared memory
+// (tmpfs), as HANDOFF_PREFIX<state file> (see s_save_alerts() and s_load_state())
+static const char* HANDOFF_PATH   = "/dev/shm";
+static const char* HANDOFF_PREFIX = "fty-alert-list-";
+
+// immutable copy of a stored alert, as published to readers
+struct SnapshotEntry
 {
-    if (!exp || !msg)
-        return;
+    std::string state;
+    std::string rule;
+    std::string name;
+    uint64_t    time = 0;
+    std::string severity;
+    uint64_t    since = 0; // start of the activity period (s), 0 while RESOLVED
+    std::string encoded;   // fty_proto message encoded in one frame, as sent in LIST replies
+};
+
+// stored alerts are copied into snapshots by chunks of SNAPSHOT_CHUNK slots (see
+// Partition::slots): a new snapshot copies the chunks holding a change and shares the others
+#define SNAPSHOT_CHUNK 256
+
+using SnapshotChunk = std::vector<std::shared_ptr<const SnapshotEntry>>;
+
+// published alerts of a partition, in the order of the store
+struct Snapshot
+{
+    std::vector<std::shared_ptr<const SnapshotChunk>> chunks;
+    size_t                                            size = 0; // alerts in all chunks
+};
+
+// states and sources of transitions, by code
+static const char* TRANSITION_STATES[]  = {"", "ACTIVE", "ACK-WIP", "ACK-IGNORE", "ACK-PAUSE", "ACK-SILENCE", "RESOLVED"};
+static const char* TRANSITION_SOURCES[] = {"stream", "acknowledge", "ttl"};
+#define TRANSITION_STREAM      0
+#define TRANSITION_ACKNOWLEDGE 1
+#define TRANSITION_TTL         2
+
+// at most TRANSITION_HISTORY recent transitions are kept per alert
+#define TRANSITION_HISTORY 8
+
+// state or severity change of a stored alert, fixed size (see AlertInfo::transitions)
+struct Transition
+{
+    uint64_t time         = 0; // s since the epoch
+    uint8_t  from         = 0; // state codes, see TRANSITION_STATES (0 - none or unknown)
+    uint8_t  to           = 0;
+    uint8_t  source       = 0; // see TRANSITION_SOURCES
+    char     severity[13] = {}; // severity after the transition, truncated
+};
+
+// per alert bookkeeping which is not part of the stored fty_proto message
+struct AlertInfo
+{
+    time_t  lastSent = 0; // last publish (monotonic clock, s)
+    int64_t expires  = 0; // TTL deadline (monotonic clock, ms), 0 if none
+    int64_t refresh  = 0; // republish deadline (monotonic clock, ms), 0 if none
+
+    // flap suppression
+    std::string lastSentState;       // state of the last published message
+    int64_t     lastTransition = 0;  // last ACTIVE <-> RESOLVED change, 0 - none (monotonic clock, ms)
+    int64_t     settle         = 0;  // end of the debounce window of a flapping alert, 0 if not flapping
+
+    bool pending         = false; // publication deferred by rate limiting
+    bool pendingFlapping = false; // deferred publication ends a flapping period
+
+    std::shared_ptr<const SnapshotEntry> snap;                          // copy in the last snapshot, NULL once changed
+    uint8_t                              change = ALERT_JOURNAL_CREATE; // mutation since the last snapshot
+
+    void*  handle = nullptr; // of the stored alert in the list of its partition
+    size_t slot   = 0;       // in Partition::slots
+
+    // ring buffer of the last transitions, allocated with the bookkeeping so that
+    // flapping alerts cost no memory
+    std::array<Transition, TRANSITION_HISTORY> transitions;
+    uint64_t                                   transitionCount = 0; // since stored
+
+    uint64_t activeSince = 0; // start of the current activity period (s), 0 while RESOLVED
+};
+
+// part of the store owned by one stream worker, alerts are partitioned by identifier
+// so that all deliveries of an alert are applied by the same worker, in order
+//
+// the worker is the only writer of its partition: acknowledgements reach it through
+// its inbox and other threads only read immutable snapshots it publishes
+struct Partition
+{
+    size_t                            id     = 0;
+    zlistx_t*                         alerts = nullptr;
+    std::map<fty_proto_t*, AlertInfo> info;
+    std::string                       inbox; // endpoint the worker pulls deliveries and requests from
+    bool                              dirty   = false;   // store changed since the last snapshot
+    zsock_t*                          journal = nullptr; // records of mutations, NULL if not journaled
+
+    // stored alerts by identifier key (see alert_id_key())
+    std::unordered_multimap<std::string, fty_proto_t*> index;
+
+    // stored alerts in the order of the store (NULL once removed, until compacted), slot
+    // i belongs to snapshot chunk i / SNAPSHOT_CHUNK
+    std::vector<fty_proto_t*> slots;
+    size_t                    removed = 0; // NULL slots
+    std::set<size_t>          changedChunks; // since the last snapshot
+
+    // last published snapshot, accessed with std::atomic_load/store only
+    std::shared_ptr<const Snapshot> snapshot;
+
+    // alerts of the partition loaded from the state file, handed over to the worker
+    std::atomic<zlistx_t*> restored {nullptr};
+    std::atomic<bool>      loaded {false}; // restored, requests about its alerts are served
+
+    // copies of alerts purged since the last snapshot, journaled once it is published
+    std::vector<std::shared_ptr<const SnapshotEntry>> purged;
+
+    // activity periods ended since the last snapshot, logged once it is published
+    std::vector<AlertActivity> ended;
+};
+
+static std::vector<Partition*> partitions;
+static std::string             repliesEndpoint; // workers answer mailbox requests there
+static bool                    verbose = false;
+
+// changes of the store since startup, drives checkpoints
+static std::atomic<uint64_t> changes {0};
+
+// the state file is loaded in the background (see init_alert_private()), until each worker
+// got its part of it the store is incomplete: requests about it and checkpoints wait for it
+static std::thread         loader;
+static std::atomic<size_t> loading {0}; // partitions not restored yet
+
+// mutations are journaled while the checkpoint actor runs, workers push them there
+static std::string       journalEndpoint;
+static std::atomic<bool> journaling {false};
+
+// at most JOURNAL_BATCH records are written to the journal with one sync
+#define JOURNAL_BATCH 1000
+
+// acknowledgements are logged (synced) by the mailbox actor before they are applied, the
+// log is emptied once the state file holds them all: batches of acknowledgements logged,
+// applied by the workers and applied before the last save of the state file
+static std::atomic<uint64_t> acksLogged {0};
+static std::atomic<uint64_t> acksApplied {0};
+static std::atomic<uint64_t> acksSaved {0};
+
+// at most ACK_BATCH acknowledgements received together are logged with one sync
+#define ACK_BATCH 100
+
+// internal metrics since startup, see alerts_metrics.h (latencies in us)
+struct Metrics
+{
+    std::atomic<uint64_t> delivered {0};     // alerts from _ALERTS_SYS applied to the store
+    std::atomic<uint64_t> published {0};     // messages sent on ALERTS
+    std::atomic<uint64_t> ttlResolved {0};   // alerts resolved on TTL expiration
+    std::atomic<uint64_t> lists {0};         // LIST requests
+    std::atomic<uint64_t> acks {0};          // acknowledgement requests
+    std::atomic<uint64_t> acksConfirmed {0}; // acknowledgements confirmed (OK)
+    std::atomic<uint64_t> suppressed {0};    // publications deferred by rate limiting
+
+    AlertHistogram deliverLatency; // applying one delivery (and queuing its publication)
+    AlertHistogram listLatency;    // answering a LIST request
+    AlertHistogram ackLatency;     // from an acknowledgement request to its confirmation
+};
+static Metrics metrics;
+
+static void s_count(std::atomic<uint64_t>& counter, uint64_t count = 1)
+{
+    counter.fetch_add(count, std::memory_order_relaxed);
+}
+
+// checkpoint defaults: save the state every CHECKPOINT_INTERVAL s if anything changed,
+// or as soon as CHECKPOINT_CHANGES changes accumulated
+#define CHECKPOINT_INTERVAL 60
+#define CHECKPOINT_CHANGES  1000
+
+// changes are durable in the journal already, so a checkpoint rewrites the state file
+// (merging the journal into it) only once the journal reached CHECKPOINT_MERGE % of its size
+#define CHECKPOINT_MERGE 50
+
+// at most MAX_PARTITIONS stream workers when their count is chosen automatically
+#define MAX_PARTITIONS 4
+
+// retention of RESOLVED alerts is enforced every RETENTION_PERIOD ms, the alerts to purge
+// are sent to the stream workers in batches of RETENTION_BATCH
+#define RETENTION_PERIOD 60000
+#define RETENTION_BATCH  500
+
+// partition owning alert ('rule', 'element')
+// hashing the folded identifier keeps alerts identified as equal in the same partition,
+// while alerts of one rule (e.g. raised on many elements at once) are spread over all of them
+static Partition& s_partition(const char* rule, const char* element)
+{
+    assert(!partitions.empty());
+    return *partitions[std::hash<std::string>()(alert_id_key(rule, element)) % partitions.size()];
+}
+
+// stored alert identified by ('rule', 'element')
+// returns NULL if not found
+static fty_proto_t* s_find_alert(Partition& part, const char* rule, const char* element)
+{
+    if (!rule || !element)
+        return nullptr;
+
+    auto range = part.index.equal_range(alert_id_key(rule, element));
+    for (auto it = range.first; it != range.second; ++it) {
+        if (is_alert_identified(it->second, rule, element))
+            return it->second;
+    }
+    return nullptr;
+}
+
+static uint8_t s_state_code(const char* state)
+{
+    for (uint8_t code = 1; code < sizeof(TRANSITION_STATES) / sizeof(TRANSITION_STATES[0]); code++) {
+        if (streq(state, TRANSITION_STATES[code]))
+            return code;
+    }
+    return 0;
+}
+
+// record transition of stored 'alert' from state 'from' (code) by 'source'
+static void s_record_transition(Partition& part, fty_proto_t* alert, uint8_t from, uint8_t source)
+{
+    AlertInfo&  info       = part.info[alert];
+    Transition& transition = info.transitions[info.transitionCount++ % TRANSITION_HISTORY];
+    transition.time        = uint64_t(zclock_time() / 1000);
+    transition.from        = from;
+    transition.to          = s_state_code(fty_proto_state(alert));
+    transition.source      = source;
+    snprintf(transition.severity, sizeof(transition.severity), "%s", fty_proto_severity(alert));
+
+    // activity period: from the transition out of RESOLVED (or creation) to the one back
+    bool active = !streq(fty_proto_state(alert), "RESOLVED");
+    if (active && !info.activeSince) {
+        info.activeSince = transition.time;
+    } else if (!active && info.activeSince) {
+        AlertActivity period;
+        period.start   = info.activeSince;
+        period.end     = transition.time;
+        period.rule    = fty_proto_rule(alert);
+        period.element = fty_proto_name(alert);
+        // severity while active, the one of the previous transition if recorded
+        period.severity = info.transitionCount > 1
+                              ? info.transitions[(info.transitionCount - 2) % TRANSITION_HISTORY].severity
+                              : transition.severity;
+        part.ended.push_back(std::move(period));
+        info.activeSince = 0;
+    }
+}
 
-    int64_t ttl = fty_proto_ttl(msg);
-    if (!ttl)
+// add 'alert' to the store
+// returns the stored alert
+static fty_proto_t* s_store_alert(Partition& part, fty_proto_t* alert)
+{
+    void*        handle = zlistx_add_end(part.alerts, alert);
+    fty_proto_t* stored = reinterpret_cast<fty_proto_t*>(zlistx_handle_item(handle));
+    part.index.emplace(alert_id_key(fty_proto_rule(stored), fty_proto_name(stored)), stored);
+    AlertInfo& info = part.info[stored];
+    info.handle     = handle;
+    info.slot       = part.slots.size();
+    part.slots.push_back(stored);
+    part.changedChunks.insert(info.slot / SNAPSHOT_CHUNK);
+    part.dirty = true;
+    changes++;
+    return stored;
+}
+
+// stored 'alert' changed by mutation 'op', it is copied again into the next snapshot
+static void s_touch_alert(Partition& part, fty_proto_t* alert, uint8_t op)
+{
+    AlertInfo& info = part.info[alert];
+    if (info.snap || info.change != ALERT_JOURNAL_CREATE)
+        info.change = op; // a creation not journaled yet stays one
+    info.snap.reset();
+    part.changedChunks.insert(info.slot / SNAPSHOT_CHUNK);
+    part.dirty = true;
+    changes++;
+}
+
+static std::shared_ptr<const SnapshotEntry> s_snapshot_entry(fty_proto_t* alert, const AlertInfo& info)
+{
+    auto entry      = std::make_shared<SnapshotEntry>();
+    entry->state    = fty_proto_state(alert);
+    entry->rule     = fty_proto_rule(alert);
+    entry->name     = fty_proto_name(alert);
+    entry->time     = fty_proto_time(alert);
+    entry->severity = fty_proto_severity(alert);
+    entry->since    = info.activeSince;
+    entry->encoded  = alert_encode_frame(alert);
+    return entry;
+}
+
+// stored alert decoded back from snapshot 'entry', NULL on error
+static fty_proto_t* s_snapshot_alert(const SnapshotEntry& entry)
+{
+    return alert_decode_frame(entry.encoded.data(), entry.encoded.size());
+}
+
+// send record of mutation 'op' to the journal
+static void s_journal_record(Partition& part, uint8_t op, const SnapshotEntry& entry)
+{
+    zmsg_t* msg = zmsg_new();
+    zmsg_addmem(msg, &op, sizeof(op));
+    zmsg_addmem(msg, entry.encoded.data(), entry.encoded.size());
+    if (zmsg_send(&msg, part.journal) != 0) {
+        log_error("journal record of partition %zu lost", part.id);
+        zmsg_destroy(&msg);
+    }
+}
+
+// send activity periods ended in 'part' to the activity log, kept with the journal
+// ACTIVITY/[start/end/rule/element/severity]...
+static void s_activity_record(Partition& part)
+{
+    zmsg_t* msg = zmsg_new();
+    zmsg_addstr(msg, "ACTIVITY");
+    for (const auto& period : part.ended) {
+        zmsg_addstrf(msg, "%" PRIu64, period.start);
+        zmsg_addstrf(msg, "%" PRIu64, period.end);
+        zmsg_addstr(msg, period.rule.c_str());
+        zmsg_addstr(msg, period.element.c_str());
+        zmsg_addstr(msg, period.severity.c_str());
+    }
+    if (zmsg_send(&msg, part.journal) != 0) {
+        log_error("%zu activity periods of partition %zu lost", part.ended.size(), part.id);
+        zmsg_destroy(&msg);
+    }
+}
+
+// drop the slots of removed alerts, every chunk of the next snapshot is copied again
+static void s_compact_slots(Partition& part)
+{
+    size_t kept = 0;
+    for (fty_proto_t* alert : part.slots) {
+        if (!alert)
+            continue;
+        part.info[alert].slot = kept;
+        part.slots[kept++]    = alert;
+    }
+    part.slots.resize(kept);
+    part.removed = 0;
+    for (size_t chunk = 0; chunk * SNAPSHOT_CHUNK < kept; chunk++)
+        part.changedChunks.insert(chunk);
+}
+
+// last snapshot published by the worker of 'part'
+static std::shared_ptr<const Snapshot> s_snapshot(Partition& part)
+{
+    return std::atomic_load(&part.snapshot);
+}
+
+// publish a new snapshot of 'part' for readers if the store changed: only the chunks holding
+// a change are copied, the others (and unchanged alerts of copied chunks) are shared with the
+// previous snapshot
+static void s_publish_snapshot(Partition& part)
+{
+    if (!part.dirty)
         return;
-    const char* rule = fty_proto_rule(msg);
-    if (!rule)
+
+    // removed slots are dropped once they are half of them, amortized over the removals
+    if (part.removed * 2 > part.slots.size())
+        s_compact_slots(part);
+
+    std::vector<std::pair<uint8_t, const SnapshotEntry*>> changed;
+    std::shared_ptr<const Snapshot>                       previous = s_snapshot(part);
+    auto                                                  snapshot = std::make_shared<Snapshot>();
+    if (previous)
+        snapshot->chunks = previous->chunks;
+    snapshot->chunks.resize((part.slots.size() + SNAPSHOT_CHUNK - 1) / SNAPSHOT_CHUNK);
+    for (size_t index : part.changedChunks) {
+        if (index >= snapshot->chunks.size())
+            break;
+        auto   chunk = std::make_shared<SnapshotChunk>();
+        size_t end   = std::min(part.slots.size(), (index + 1) * SNAPSHOT_CHUNK);
+        for (size_t slot = index * SNAPSHOT_CHUNK; slot < end; slot++) {
+            fty_proto_t* cursor = part.slots[slot];
+            if (!cursor)
+                continue;
+            AlertInfo& info = part.info[cursor];
+            if (!info.snap) {
+                info.snap = s_snapshot_entry(cursor, info);
+                changed.emplace_back(info.change, info.snap.get());
+            }
+            chunk->push_back(info.snap);
+        }
+        snapshot->chunks[index] = chunk;
+    }
+    for (const auto& chunk : snapshot->chunks)
+        snapshot->size += chunk->size();
+    std::atomic_store(&part.snapshot, std::shared_ptr<const Snapshot>(snapshot));
+    part.changedChunks.clear();
+    part.dirty = false;
+
+    // purges first: an alert purged then created again in the batch is created on replay
+    if (part.journal) {
+        for (const auto& entry : part.purged)
+            s_journal_record(part, ALERT_JOURNAL_PURGE, *entry);
+        for (const auto& change : changed)
+            s_journal_record(part, change.first, *change.second);
+        if (!part.ended.empty())
+            s_activity_record(part);
+    }
+    part.purged.clear();
+    part.ended.clear();
+}
+
+// republish at most REFRESH_BATCH due alerts every REFRESH_PERIOD ms
+#define REFRESH_BATCH  50
+#define REFRESH_PERIOD 100
+
+// retry deferred (rate limited) publications every RATE_LIMIT_PERIOD ms
+#define RATE_LIMIT_PERIOD 100
+
+// suppressed publications are counted for at most RATE_LIMIT_RULES rules, until all
+// deferred publications are sent
+#define RATE_LIMIT_RULES 100
+
+// at most INGEST_QUEUE_SIZE deliveries are pulled from malamute ahead of processing,
+// which runs INGEST_BATCH of them before looking for new deliveries again; while the
+// state file loads, a full queue is checked for the end of the load every INGEST_PAUSE ms
+#define INGEST_QUEUE_SIZE 1000
+#define INGEST_BATCH      100
+#define INGEST_PAUSE      100
+
+// token bucket: 'rate' messages per second, bursts up to 'burst' messages
+struct TokenBucket
+{
+    double  tokens = 0;
+    int64_t last   = 0; // last refill (monotonic clock, ms)
+};
+
+struct RateLimit
+{
+    double rate  = 0; // 0 - unlimited
+    double burst = 0;
+};
+
+// message of a stream worker, sent once the snapshot holding the change it announces is
+// published (see s_stream_flush())
+struct Outgoing
+{
+    std::string  subject;         // on ALERTS, empty - reply to the mailbox actor
+    zmsg_t*      msg   = nullptr;
+    fty_proto_t* alert = nullptr; // stored alert whose state is published, NULL if none
+};
+
+// deadlines of stored alerts, ordered by due time so that timers
+// only touch alerts whose deadline has actually passed
+using Deadlines = std::set<std::pair<int64_t, fty_proto_t*>>;
+
+// state owned by a stream worker
+struct StreamContext
+{
+    Partition* part    = nullptr; // partition of the store the worker applies deliveries to
+    zsock_t*   replies = nullptr; // answers to requests of the mailbox actor
+    bool       loaded  = false;   // partition restored, deliveries are queued until then
+
+    Deadlines expirations;      // TTL deadlines
+    Deadlines refreshes;        // republish deadlines of ACTIVE alerts
+    int64_t   nextRefreshBatch = 0;
+    Deadlines settles;          // debounce deadlines of flapping alerts
+
+    // flap suppression debounce window (ms) per rule, 0 disables it
+    int64_t                        flapWindow = 0; // for rules not listed in flapWindows
+    std::map<std::string, int64_t> flapWindows;
+
+    // rate limiting of publications on ALERTS per rule (see also globalRate)
+    RateLimit                          ruleLimit;
+    std::map<std::string, TokenBucket> ruleBuckets;
+    std::deque<fty_proto_t*>           pending;        // alerts whose publication was deferred
+    uint64_t                           suppressed = 0; // rate limited publications
+    std::map<std::string, uint64_t>    ruleSuppressed; // since the last time pending emptied
+
+    AlertIngestQueue ingest; // deliveries pulled from the inbox
+
+    std::vector<Outgoing> outbox; // messages announcing changes not in the snapshot yet
+};
+
+// rate limiting of publications on ALERTS, all stream workers together
+// lock free equivalent of a token bucket (GCRA): messages are spaced by 'interval'
+// on average and may run up to 'tolerance' ahead of that schedule
+static struct
+{
+    std::atomic<int64_t> interval {0};  // us per message, 0 - unlimited
+    std::atomic<int64_t> tolerance {0}; // us, (burst - 1) * interval
+    std::atomic<int64_t> tat {0};       // theoretical arrival time of the next message (monotonic clock, us)
+} globalRate;
+
+static void s_global_rate_set(double rate, double burst)
+{
+    int64_t interval = rate > 0 ? int64_t(1000000 / rate) : 0;
+    globalRate.tolerance.store(int64_t((burst - 1) * double(interval)));
+    globalRate.interval.store(interval);
+}
+
+// take a slot of the global rate limit, false if there is none left
+static bool s_global_rate_take(bool take = true)
+{
+    int64_t interval = globalRate.interval.load();
+    if (interval <= 0)
+        return true;
+
+    int64_t now       = zclock_usecs();
+    int64_t tolerance = globalRate.tolerance.load();
+    int64_t tat       = globalRate.tat.load();
+    while (true) {
+        int64_t next = std::max(tat, now) + interval;
+        if (next - now > tolerance + interval)
+            return false;
+        if (!take || globalRate.tat.compare_exchange_weak(tat, next))
+            return true;
+    }
+}
+
+// refill 'bucket' and check whether it holds a token
+static bool s_bucket_ready(TokenBucket& bucket, const RateLimit& limit, int64_t now)
+{
+    if (limit.rate <= 0)
+        return true;
+
+    if (bucket.last == 0)
+        bucket.tokens = limit.burst;
+    else
+        bucket.tokens = std::min(limit.burst, bucket.tokens + double(now - bucket.last) * limit.rate / 1000);
+    bucket.last = now;
+    return bucket.tokens >= 1;
+}
+
+// take a token for publishing an alert of 'rule'
+// true - publication allowed, false - rate limited
+static bool s_rate_limit_take(StreamContext& ctx, const char* rule)
+{
+    int64_t      now        = zclock_mono();
+    TokenBucket* ruleBucket = nullptr;
+    if (ctx.ruleLimit.rate > 0) {
+        ruleBucket = &ctx.ruleBuckets[rule];
+        if (!s_bucket_ready(*ruleBucket, ctx.ruleLimit, now))
+            return false;
+    }
+
+    if (!s_global_rate_take())
+        return false;
+    if (ruleBucket)
+        ruleBucket->tokens -= 1;
+    return true;
+}
+
+// true if the global rate limit has no slot left
+static bool s_global_rate_exhausted()
+{
+    return !s_global_rate_take(false);
+}
+
+// publication of stored 'alert' was rate limited, its latest state is published later
+// ('flapping' - with auxiliary flag flapping, as the end of a flapping period)
+static void s_defer_publish(StreamContext& ctx, fty_proto_t* alert, const char* rule, bool flapping = false)
+{
+    if (ctx.suppressed++ == 0 || ctx.pending.empty())
+        log_warning("rate limit reached, deferring publications on ALERTS");
+    s_count(metrics.suppressed);
+
+    auto it = ctx.ruleSuppressed.find(rule);
+    if (it != ctx.ruleSuppressed.end())
+        it->second++;
+    else if (ctx.ruleSuppressed.size() < RATE_LIMIT_RULES)
+        ctx.ruleSuppressed.emplace(rule, 1);
+
+    AlertInfo& info = ctx.part->info[alert];
+    info.pendingFlapping |= flapping;
+    if (!info.pending) {
+        info.pending = true;
+        ctx.pending.push_back(alert);
+    }
+}
+
+// queue 'msg' for ALERTS with 'subject' (takes ownership), publishing the state of stored
+// 'alert' unless NULL
+static void s_outbox_publish(StreamContext& ctx, const char* subject, zmsg_t* msg, fty_proto_t* alert = nullptr)
+{
+    Outgoing out;
+    out.subject = subject;
+    out.msg     = msg;
+    out.alert   = alert;
+    ctx.outbox.push_back(std::move(out));
+}
+
+// queue reply 'msg' to the mailbox actor (takes ownership)
+static void s_outbox_reply(StreamContext& ctx, zmsg_t* msg)
+{
+    Outgoing out;
+    out.msg = msg;
+    ctx.outbox.push_back(std::move(out));
+}
+
+// publish the snapshot of the partition, then send the queued messages: readers see a
+// change before consumers of ALERTS (or the mailbox actor) hear of it, while the snapshot
+// is built once per batch of changes
+static void s_stream_flush(mlm_client_t* client, StreamContext& ctx)
+{
+    s_publish_snapshot(*ctx.part);
+
+    for (Outgoing& out : ctx.outbox) {
+        if (out.subject.empty()) {
+            if (zmsg_send(&out.msg, ctx.replies) != 0) {
+                log_error("reply of stream worker %zu lost", ctx.part->id);
+                zmsg_destroy(&out.msg);
+            }
+            continue;
+        }
+        if (mlm_client_send(client, out.subject.c_str(), &out.msg) != 0) {
+            zmsg_destroy(&out.msg);
+            log_error("mlm_client_send (subject = '%s') failed", out.subject.c_str());
+            // the alert is published again as a deferred one
+            if (out.alert) {
+                AlertInfo& info = ctx.part->info[out.alert];
+                if (!info.pending) {
+                    info.pending = true;
+                    ctx.pending.push_back(out.alert);
+                }
+            }
+            continue;
+        }
+        s_count(metrics.published);
+    }
+    ctx.outbox.clear();
+}
+
+// (re)arm TTL deadline of stored 'alert'
+static void s_set_alert_lifetime(StreamContext& ctx, fty_proto_t* alert, int64_t ttl)
+{
+    if (!alert || !ttl)
         return;
-    int64_t* time = reinterpret_cast<int64_t*>(malloc(sizeof(int64_t)));
-    if (!time)
+
+    AlertInfo& info = ctx.part->info[alert];
+    if (info.expires)
+        ctx.expirations.erase(std::make_pair(info.expires, alert));
+
+    info.expires = zclock_mono() + ttl * 1000;
+    ctx.expirations.emplace(info.expires, alert);
+    log_debug(" ##### alert (%s, %s) with ttl %" PRIi64, fty_proto_rule(alert), fty_proto_name(alert), ttl);
+}
+
+// (re)arm republish deadline of stored 'alert', half way to its consumers' timeout
+static void s_schedule_refresh(StreamContext& ctx, fty_proto_t* alert, int64_t ttl)
+{
+    AlertInfo& info = ctx.part->info[alert];
+    if (info.refresh) {
+        ctx.refreshes.erase(std::make_pair(info.refresh, alert));
+        info.refresh = 0;
+    }
+    if (ttl <= 0)
         return;
 
-    *time = zclock_mono() / 1000 + ttl;
-    zhash_update(exp, rule, time);
-    log_debug(" ##### rule %s with ttl %" PRIi64, rule, ttl);
-    zhash_freefn(exp, rule, free);
+    info.refresh = zclock_mono() + ttl * 1000 / 2;
+    ctx.refreshes.emplace(info.refresh, alert);
 }
 
-static bool s_alert_expired(zhash_t* exp, fty_proto_t* msg)
+static int64_t s_flap_window(const StreamContext& ctx, const char* rule)
 {
-    if (!exp || !msg)
-        return false;
+    auto it = ctx.flapWindows.find(rule);
+    return it != ctx.flapWindows.end() ? it->second : ctx.flapWindow;
+}
 
-    const char* rule = fty_proto_rule(msg);
-    if (!rule)
+// record ACTIVE <-> RESOLVED transition of stored 'alert'
+// true - alert is flapping (second change within the debounce window, or still in it),
+// publication is deferred to the end of the window
+static bool s_flap_detect(StreamContext& ctx, fty_proto_t* alert)
+{
+    int64_t window = s_flap_window(ctx, fty_proto_rule(alert));
+    if (window <= 0)
         return false;
 
-    int64_t* time = reinterpret_cast<int64_t*>(zhash_lookup(exp, rule));
-    if (!time) {
+    AlertInfo& info     = ctx.part->info[alert];
+    int64_t    now      = zclock_mono();
+    bool       flapping = info.settle || (info.lastTransition && now - info.lastTransition < window);
+
+    info.lastTransition = now;
+    if (!flapping)
         return false;
+
+    if (info.settle) {
+        ctx.settles.erase(std::make_pair(info.settle, alert));
+    } else {
+        log_info("alert (%s, %s) is flapping", fty_proto_rule(alert), fty_proto_name(alert));
+        fty_proto_aux_insert(alert, "flapping", "%s", "1");
     }
-    return (*time < zclock_mono() / 1000);
+    info.settle = now + window;
+    ctx.settles.emplace(info.settle, alert);
+    return true;
 }
 
-static void s_clear_long_time_expired(zhash_t* exp)
+// time (ms) the stream worker may sleep before the next deadline is due
+static int s_deadlines_timeout(const Deadlines& deadlines, int64_t not_before, int max_timeout)
 {
-    if (!exp)
-        return;
+    if (deadlines.empty())
+        return max_timeout;
 
-    zlist_t* keys = zhash_keys(exp);
-    int64_t  now  = zclock_mono() / 1000;
+    int64_t wait = std::max(deadlines.begin()->first, not_before) - zclock_mono();
+    if (wait < 0)
+        return 0;
+    return wait < max_timeout ? int(wait) : max_timeout;
+}
 
-    const char* rule = reinterpret_cast<char*>(zlist_first(keys));
-    while (rule) {
-        int64_t* time = reinterpret_cast<int64_t*>(zhash_lookup(exp, rule));
-        if (*time < now - 3600)
-            zhash_delete(exp, rule);
-        rule = reinterpret_cast<char*>(zlist_next(keys));
-    }
-    zlist_destroy(&keys);
+static int s_stream_timeout(const StreamContext& ctx, int max_timeout)
+{
+    if (ctx.ingest.size > 0 && ctx.loaded)
+        return 0;
+    if (ctx.ingest.size >= INGEST_QUEUE_SIZE && max_timeout > INGEST_PAUSE)
+        max_timeout = INGEST_PAUSE;
+    int timeout = s_deadlines_timeout(ctx.expirations, 0, max_timeout);
+    timeout     = s_deadlines_timeout(ctx.settles, 0, timeout);
+    if (!ctx.pending.empty() && timeout > RATE_LIMIT_PERIOD)
+        timeout = RATE_LIMIT_PERIOD;
+    return s_deadlines_timeout(ctx.refreshes, ctx.nextRefreshBatch, timeout);
 }
 
-static void s_resolve_expired_alerts(zhash_t* exp)
+static void s_resolve_expired_alerts(StreamContext& ctx)
 {
-    if (!exp || !alerts)
+    Deadlines& exp = ctx.expirations;
+    int64_t    now = zclock_mono();
+    if (exp.empty() || exp.begin()->first > now)
         return;
 
-    alertMtx.lock();
-    fty_proto_t* cursor = reinterpret_cast<fty_proto_t*>(zlistx_first(alerts));
-    while (cursor) {
-        if (s_alert_expired(exp, cursor) && streq(fty_proto_state(cursor), "ACTIVE")) {
+    while (!exp.empty() && exp.begin()->first <= now) {
+        fty_proto_t* cursor = exp.begin()->second;
+        exp.erase(exp.begin());
+        ctx.part->info[cursor].expires = 0;
+
+        if (streq(fty_proto_state(cursor), "ACTIVE")) {
             fty_proto_set_state(cursor, "%s", "RESOLVED");
             std::string new_desc = JSONIFY("%s - %s", fty_proto_description(cursor), "TTLCLEANUP");
             fty_proto_set_description(cursor, "%s", new_desc.c_str());
+            s_record_transition(*ctx.part, cursor, s_state_code("ACTIVE"), TRANSITION_TTL);
+            s_touch_alert(*ctx.part, cursor, ALERT_JOURNAL_RESOLVE);
+            s_count(metrics.ttlResolved);
 
             if (verbose) {
                 log_debug("s_resolve_expired_alerts: resolving alert");
                 fty_proto_print(cursor);
             }
         }
-        cursor = reinterpret_cast<fty_proto_t*>(zlistx_next(alerts));
     }
-    alertMtx.unlock();
+}
 
-    s_clear_long_time_expired(exp);
+// lane of delivered 'alert', compared to the stored one
+static int s_ingest_lane(Partition& part, fty_proto_t* alert)
+{
+    if (strcasecmp(fty_proto_severity(alert), "CRITICAL") == 0)
+        return ALERT_LANE_CRITICAL;
+
+    fty_proto_t* stored = s_find_alert(part, fty_proto_rule(alert), fty_proto_name(alert));
+    if (!stored || !streq(fty_proto_severity(stored), fty_proto_severity(alert)))
+        return ALERT_LANE_CHANGE;
+    if (streq(fty_proto_state(alert), "RESOLVED") != streq(fty_proto_state(stored), "RESOLVED"))
+        return ALERT_LANE_CHANGE;
+    return ALERT_LANE_REFRESH;
 }
 
-static void s_handle_stream_deliver(mlm_client_t* client, zmsg_t** msg_p, zhash_t* expirations)
+// decode delivered message, NULL if it is not an ACTIVE or RESOLVED alert
+static fty_proto_t* s_stream_decode(zmsg_t** msg_p)
 {
-    assert(client);
     assert(msg_p);
 
     if (!fty_proto_is(*msg_p)) {
         log_error("s_handle_stream_deliver (): Message not fty_proto");
-        return;
+        zmsg_destroy(msg_p);
+        return nullptr;
     }
 
     fty_proto_t* newAlert = fty_proto_decode(msg_p);
     if (!newAlert || fty_proto_id(newAlert) != FTY_PROTO_ALERT) {
         fty_proto_destroy(&newAlert);
         log_warning("s_handle_stream_deliver (): Message not FTY_PROTO_ALERT.");
-        return;
+        return nullptr;
     }
 
     // handle *only* ACTIVE or RESOLVED alerts
     if (!streq(fty_proto_state(newAlert), "ACTIVE") && !streq(fty_proto_state(newAlert), "RESOLVED")) {
         fty_proto_destroy(&newAlert);
         log_warning("s_handle_stream_deliver (): Message state not ACTIVE or RESOLVED. Not publishing any further.");
-        return;
+        return nullptr;
+    }
+    return newAlert;
+}
+
+// queue delivered 'newAlert' in its ingest lane (takes ownership)
+static void s_ingest_enqueue(StreamContext& ctx, const char* subject, fty_proto_t* newAlert)
+{
+    AlertIngestEntry entry;
+    entry.subject = subject ? subject : "";
+    entry.key     = alert_id_key(fty_proto_rule(newAlert), fty_proto_name(newAlert));
+    entry.alert   = newAlert;
+    alert_ingest_push(ctx.ingest, s_ingest_lane(*ctx.part, newAlert), std::move(entry));
+}
+
+static void s_stream_command(StreamContext& ctx, const char* cmd, zmsg_t* msg);
+static void s_stream_acknowledge(StreamContext& ctx, zmsg_t* msg, bool apply);
+static void s_stream_purge(StreamContext& ctx, zmsg_t* msg);
+static void s_stream_transitions(StreamContext& ctx, zmsg_t* msg);
+
+// pull pending deliveries from the worker inbox into the ingest lanes, serving
+// requests and commands met on the way, until the ingest queue is full (the rest stays
+// in the inbox: once it is full too, the stream actor waits)
+// 0 - success, -1 - interrupted
+static int s_ingest_receive(zsock_t* inbox, StreamContext& ctx)
+{
+    while (ctx.ingest.size < INGEST_QUEUE_SIZE && (zsock_events(inbox) & ZMQ_POLLIN)) {
+        zmsg_t* msg = zmsg_recv(inbox);
+        if (!msg)
+            return -1;
+
+        char* cmd = zmsg_popstr(msg);
+        if (cmd && streq(cmd, "DELIVER")) {
+            // DELIVER/subject/alert - pointer to the decoded alert, owned by the worker from now on
+            char*        subject = zmsg_popstr(msg);
+            zframe_t*    frame   = zmsg_pop(msg);
+            fty_proto_t* alert   = nullptr;
+            if (frame && zframe_size(frame) == sizeof(alert))
+                memcpy(&alert, zframe_data(frame), sizeof(alert));
+            if (alert)
+                s_ingest_enqueue(ctx, subject, alert);
+            zframe_destroy(&frame);
+            zstr_free(&subject);
+        } else if (cmd && (streq(cmd, "ACK") || streq(cmd, "ACKAPPLY"))) {
+            s_stream_acknowledge(ctx, msg, streq(cmd, "ACKAPPLY"));
+        } else if (cmd && streq(cmd, "PURGE")) {
+            s_stream_purge(ctx, msg);
+        } else if (cmd && streq(cmd, "TRANSITIONS")) {
+            s_stream_transitions(ctx, msg);
+        } else if (cmd && streq(cmd, "RESTORED")) {
+            // wake up, the partition loaded from the state file is taken over by the loop
+        } else if (cmd) {
+            s_stream_command(ctx, cmd, msg);
+        }
+        zstr_free(&cmd);
+        zmsg_destroy(&msg);
     }
+    return 0;
+}
+
+static void s_handle_stream_deliver(const char* subject, fty_proto_t* newAlert, StreamContext& ctx);
+
+// apply queued deliveries, most important lane first
+static void s_ingest_process(StreamContext& ctx, int batch)
+{
+    // deliveries received while the state file loads apply on top of it
+    if (!ctx.loaded)
+        return;
+
+    AlertIngestEntry entry;
+    while (batch-- > 0 && alert_ingest_pop(ctx.ingest, entry))
+        s_handle_stream_deliver(entry.subject.c_str(), entry.alert, ctx);
+}
+
+// apply queued deliveries of alert ('rule', 'element') if any, so that a request received
+// after them sees them
+static void s_ingest_flush(StreamContext& ctx, const char* rule, const char* element)
+{
+    AlertIngestEntry entry;
+    std::string      key = alert_id_key(rule, element);
+    while (ctx.loaded && alert_ingest_take(ctx.ingest, key, entry))
+        s_handle_stream_deliver(entry.subject.c_str(), entry.alert, ctx);
+}
+
+// apply delivered 'newAlert' to the store and publish it if needed (takes ownership)
+static void s_handle_stream_deliver(const char* subject, fty_proto_t* newAlert, StreamContext& ctx)
+{
+    assert(subject);
+    assert(newAlert);
 
     if (verbose) {
         log_debug("----> printing alert ");
         fty_proto_print(newAlert);
     }
+    int64_t started = zclock_usecs();
 
-    alertMtx.lock();
+    Partition& part = *ctx.part;
+    AlertInfo* info = nullptr;
 
-    fty_proto_t* cursor = reinterpret_cast<fty_proto_t*>(zlistx_first(alerts));
-    bool         found  = false;
-    while (cursor) {
-        if (alert_id_comparator(cursor, newAlert) == 0) {
-            found = true;
-            break;
-        }
-        cursor = reinterpret_cast<fty_proto_t*>(zlistx_next(alerts));
-    }
+    fty_proto_t* cursor = s_find_alert(part, fty_proto_rule(newAlert), fty_proto_name(newAlert));
+    bool         found  = cursor != nullptr;
 
-    bool send = true; // default, publish
+    bool send       = true; // default, publish
+    bool transition = false;
 
     if (!found) {
         // Record creation time
         fty_proto_aux_insert(newAlert, "ctime", "%" PRIu64, fty_proto_time(newAlert));
 
-        zlistx_add_end(alerts, newAlert);
-        cursor                 = reinterpret_cast<fty_proto_t*>(zlistx_last(alerts));
-        alertsLastSent[cursor] = 0;
-        s_set_alert_lifetime(expirations, newAlert);
+        cursor         = s_store_alert(part, newAlert);
+        info           = &part.info[cursor];
+        info->lastSent = 0;
+        s_record_transition(part, cursor, 0, TRANSITION_STREAM);
+        s_set_alert_lifetime(ctx, cursor, fty_proto_ttl(newAlert));
     } else {
+        info         = &part.info[cursor];
+        uint8_t from = s_state_code(fty_proto_state(cursor));
+
         // Append creation time to new alert
         fty_proto_aux_insert(newAlert, "ctime", "%" PRIu64, fty_proto_aux_number(cursor, "ctime", 0));
 
@@ -200,11 +992,12 @@ static void s_handle_stream_deliver(mlm_client_t* client, zmsg_t** msg_p, zhash_
                 fty_proto_set_state(cursor, "%s", fty_proto_state(newAlert));
                 fty_proto_set_time(cursor, fty_proto_time(newAlert));
                 fty_proto_set_metadata(cursor, "%s", fty_proto_metadata(newAlert));
+                transition = true;
             } else {
                 send = false;
             }
         } else { // state (newAlert) == ACTIVE
-            s_set_alert_lifetime(expirations, newAlert);
+            s_set_alert_lifetime(ctx, cursor, fty_proto_ttl(newAlert));
 
             // copy the description only if the alert is active
             fty_proto_set_description(cursor, "%s", fty_proto_description(newAlert));
@@ -217,6 +1010,7 @@ static void s_handle_stream_deliver(mlm_client_t* client, zmsg_t** msg_p, zhash_
                 fty_proto_set_time(cursor, fty_proto_time(newAlert));
                 fty_proto_set_state(cursor, "%s", fty_proto_state(newAlert));
                 fty_proto_set_metadata(cursor, "%s", fty_proto_metadata(newAlert));
+                transition = true;
             } else if (!streq(fty_proto_state(cursor), "ACTIVE")) {
                 // fty_proto_state (cursor) ==  ACK-XXXX
                 if (sameSeverity) {
@@ -228,7 +1022,7 @@ static void s_handle_stream_deliver(mlm_client_t* client, zmsg_t** msg_p, zhash_
                 // Always active and same severity => don't publish...
                 if (sameSeverity) {
                     // ... if we're not at risk of timing out
-                    time_t lastSent = alertsLastSent[cursor];
+                    time_t lastSent = info->lastSent;
                     if ((zclock_mono() / 1000) < (lastSent + fty_proto_ttl(cursor) / 2)) {
                         send = false;
                     }
@@ -250,36 +1044,182 @@ static void s_handle_stream_deliver(mlm_client_t* client, zmsg_t** msg_p, zhash_
             actions = zlist_dup(fty_proto_action(newAlert));
         }
         fty_proto_set_action(cursor, &actions);
-    }
 
-    alertMtx.unlock();
+        // while flapping, only the state at the end of the debounce window is published
+        if (transition && s_flap_detect(ctx, cursor)) {
+            send = false;
+        } else if (info->settle) {
+            send = false;
+        }
+        if (from != s_state_code(fty_proto_state(cursor)) || !sameSeverity)
+            s_record_transition(part, cursor, from, TRANSITION_STREAM);
+        s_touch_alert(part, cursor, ALERT_JOURNAL_UPDATE);
+    }
 
-    if (send) {
+    if (send && !s_rate_limit_take(ctx, fty_proto_rule(newAlert))) {
+        s_defer_publish(ctx, cursor, fty_proto_rule(newAlert));
+    } else if (send) {
         log_info("send %s (%s/%s)", fty_proto_rule(newAlert), fty_proto_severity(newAlert), fty_proto_state(newAlert));
 
         fty_proto_t* alert_dup = fty_proto_dup(newAlert);
         zmsg_t*      encoded   = fty_proto_encode(&alert_dup);
         fty_proto_destroy(&alert_dup);
         assert(encoded);
+        s_outbox_publish(ctx, subject, encoded, cursor);
+
+        // Update last sent time
+        info->pending         = false;
+        info->pendingFlapping = false;
+        info->lastSent        = zclock_mono() / 1000;
+        info->lastSentState   = fty_proto_state(newAlert);
+        s_schedule_refresh(ctx, cursor, streq(fty_proto_state(newAlert), "ACTIVE") ? fty_proto_ttl(newAlert) : 0);
+    }
+
+    fty_proto_destroy(&newAlert);
+    s_count(metrics.delivered);
+    alert_histogram_record(metrics.deliverLatency, uint64_t(zclock_usecs() - started));
+}
+
+static int s_send_stored_alert(StreamContext& ctx, fty_proto_t* alert, bool flapping);
+
+// publish current copy of stored 'alert' on ALERTS, unless rate limited
+// 0 - success (or deferred), -1 - error
+static int s_publish_stored_alert(StreamContext& ctx, fty_proto_t* alert, bool flapping)
+{
+    if (!s_rate_limit_take(ctx, fty_proto_rule(alert))) {
+        s_defer_publish(ctx, alert, fty_proto_rule(alert), flapping);
+        return 0;
+    }
+    return s_send_stored_alert(ctx, alert, flapping);
+}
+
+// publish latest state of alerts deferred by rate limiting, as tokens are available
+static void s_publish_pending_alerts(StreamContext& ctx)
+{
+    size_t count = ctx.pending.size();
+    while (count-- > 0) {
+        fty_proto_t* cursor = ctx.pending.front();
+        ctx.pending.pop_front();
+        auto found = ctx.part->info.find(cursor);
+        if (found == ctx.part->info.end() || !found->second.pending)
+            continue; // purged or published meanwhile
+        AlertInfo& info = found->second;
+        if (info.settle) {
+            // flapping again, the end of the debounce window publishes the state it settles in
+            info.pending = false;
+            continue;
+        }
+
+        if (!s_rate_limit_take(ctx, fty_proto_rule(cursor))) {
+            ctx.pending.push_back(cursor);
+            if (s_global_rate_exhausted())
+                break;
+            continue;
+        }
+        if (s_send_stored_alert(ctx, cursor, info.pendingFlapping) != 0)
+            ctx.pending.push_back(cursor);
+    }
+
+    if (ctx.pending.empty() && !ctx.ruleSuppressed.empty()) {
+        log_info("rate limit: all deferred publications sent (%" PRIu64 " suppressed so far)", ctx.suppressed);
+        for (const auto& it : ctx.ruleSuppressed)
+            log_debug("rate limit: %" PRIu64 " publications of rule '%s' suppressed", it.second, it.first.c_str());
+        ctx.ruleSuppressed.clear();
+    }
+}
+
+// publish current copy of stored 'alert' on ALERTS
+// 0 - success, -1 - error
+static int s_send_stored_alert(StreamContext& ctx, fty_proto_t* alert, bool flapping)
+{
+    fty_proto_t* copy = fty_proto_dup(alert);
+    if (!copy) {
+        log_error("fty_proto_dup () failed");
+        return -1;
+    }
+    if (flapping)
+        fty_proto_aux_insert(copy, "flapping", "%s", "1");
+
+    int64_t     ttl     = fty_proto_ttl(copy);
+    std::string state   = fty_proto_state(copy);
+    char*       subject = zsys_sprintf("%s/%s@%s", fty_proto_rule(copy), fty_proto_severity(copy), fty_proto_name(copy));
+    log_debug("send %s (%s/%s)", fty_proto_rule(copy), fty_proto_severity(copy), fty_proto_state(copy));
+
+    s_outbox_publish(ctx, subject, fty_proto_encode(&copy), alert);
+    zstr_free(&subject);
 
-        int rv = mlm_client_send(client, mlm_client_subject(client), &encoded);
-        zmsg_destroy(&encoded);
+    AlertInfo& info      = ctx.part->info[alert];
+    info.pending         = false;
+    info.pendingFlapping = false;
+    info.lastSent        = zclock_mono() / 1000;
+    info.lastSentState   = state;
+    s_schedule_refresh(ctx, alert, state == "ACTIVE" ? ttl : 0);
+    return 0;
+}
+
+// republish ACTIVE alerts before downstream consumers time them out,
+// a limited batch at a time to avoid bursts when many are due together
+static void s_refresh_alerts(StreamContext& ctx)
+{
+    int64_t now = zclock_mono();
+    if (ctx.refreshes.empty() || ctx.refreshes.begin()->first > now || ctx.nextRefreshBatch > now)
+        return;
+
+    int count = 0;
+    while (!ctx.refreshes.empty() && ctx.refreshes.begin()->first <= now) {
+        if (count == REFRESH_BATCH) {
+            ctx.nextRefreshBatch = now + REFRESH_PERIOD;
+            return;
+        }
+
+        fty_proto_t* cursor = ctx.refreshes.begin()->second;
+        ctx.refreshes.erase(ctx.refreshes.begin());
+        AlertInfo& info = ctx.part->info[cursor];
+        info.refresh    = 0;
 
-        if (rv == -1) {
-            log_error("mlm_client_send (subject = '%s') failed", mlm_client_subject(client));
-        } else { // Update last sent time
-            alertsLastSent[cursor] = zclock_mono() / 1000;
+        if (!streq(fty_proto_state(cursor), "ACTIVE") || info.settle)
+            continue;
+
+        if (s_publish_stored_alert(ctx, cursor, false) != 0) {
+            // try again a bit later, consumers still time the alert out otherwise
+            info.refresh = now + REFRESH_PERIOD;
+            ctx.refreshes.emplace(info.refresh, cursor);
         }
+        count++;
     }
+    ctx.nextRefreshBatch = 0;
+}
 
-    fty_proto_destroy(&newAlert);
+// end of debounce window of flapping alerts: publish the state they settled in
+static void s_settle_flapping_alerts(StreamContext& ctx)
+{
+    int64_t now = zclock_mono();
+    while (!ctx.settles.empty() && ctx.settles.begin()->first <= now) {
+        fty_proto_t* cursor = ctx.settles.begin()->second;
+        ctx.settles.erase(ctx.settles.begin());
+
+        AlertInfo& info = ctx.part->info[cursor];
+        info.settle     = 0;
+
+        zhash_delete(fty_proto_aux(cursor), "flapping");
+        s_touch_alert(*ctx.part, cursor, ALERT_JOURNAL_UPDATE);
+        bool changed = info.lastSentState != fty_proto_state(cursor);
+
+        log_info("alert (%s, %s) stopped flapping", fty_proto_rule(cursor), fty_proto_name(cursor));
+        if (changed)
+            s_publish_stored_alert(ctx, cursor, true);
+    }
 }
 
-static void s_send_error_response(mlm_client_t* client, const char* subject, const char* reason)
+// 'sender' - recipient of the response, the sender of the current message by default
+static void s_send_error_response(
+    mlm_client_t* client, const char* subject, const char* reason, const char* sender = nullptr)
 {
     assert(client);
     assert(subject);
     assert(reason);
+    if (!sender)
+        sender = mlm_client_sender(client);
 
     zmsg_t* reply = zmsg_new();
     assert(reply);
@@ -287,19 +1227,20 @@ static void s_send_error_response(mlm_client_t* client, const char* subject, con
     zmsg_addstr(reply, "ERROR");
     zmsg_addstr(reply, reason);
 
-    int rv = mlm_client_sendto(client, mlm_client_sender(client), subject, nullptr, 5000, &reply);
+    int rv = mlm_client_sendto(client, sender, subject, nullptr, 5000, &reply);
     if (rv != 0) {
         zmsg_destroy(&reply);
-        log_error("mlm_client_sendto (sender = '%s', subject = '%s', timeout = '5000') failed.",
-            mlm_client_sender(client), subject);
+        log_error("mlm_client_sendto (sender = '%s', subject = '%s', timeout = '5000') failed.", sender, subject);
     }
 }
 
-static void s_handle_rfc_alerts_list(mlm_client_t* client, zmsg_t** msg_p)
+static void s_handle_rfc_alerts_list(mlm_client_t* client, const char* sender, zmsg_t** msg_p)
 {
     assert(client);
     assert(msg_p && *msg_p);
-    assert(alerts);
+    assert(!partitions.empty());
+    int64_t started = zclock_usecs();
+    s_count(metrics.lists);
 
     zmsg_t* msg     = *msg_p;
     char*   command = zmsg_popstr(msg);
@@ -308,7 +1249,7 @@ static void s_handle_rfc_alerts_list(mlm_client_t* client, zmsg_t** msg_p)
         command = nullptr;
         zmsg_destroy(&msg);
         std::string err = TRANSLATE_ME("BAD_MESSAGE");
-        s_send_error_response(client, RFC_ALERTS_LIST_SUBJECT, err.c_str());
+        s_send_error_response(client, RFC_ALERTS_LIST_SUBJECT, err.c_str(), sender);
         return;
     }
 
@@ -322,7 +1263,7 @@ static void s_handle_rfc_alerts_list(mlm_client_t* client, zmsg_t** msg_p)
             correlation_id = nullptr;
             zmsg_destroy(&msg);
             std::string err = TRANSLATE_ME("BAD_MESSAGE");
-            s_send_error_response(client, RFC_ALERTS_LIST_SUBJECT, err.c_str());
+            s_send_error_response(client, RFC_ALERTS_LIST_SUBJECT, err.c_str(), sender);
             return;
         }
     }
@@ -337,7 +1278,7 @@ static void s_handle_rfc_alerts_list(mlm_client_t* client, zmsg_t** msg_p)
         correlation_id = nullptr;
         free(state);
         state = nullptr;
-        s_send_error_response(client, RFC_ALERTS_LIST_SUBJECT, "NOT_FOUND");
+        s_send_error_response(client, RFC_ALERTS_LIST_SUBJECT, "NOT_FOUND", sender);
         return;
     }
 
@@ -349,73 +1290,497 @@ static void s_handle_rfc_alerts_list(mlm_client_t* client, zmsg_t** msg_p)
         zmsg_addstr(reply, "LIST");
     }
     zmsg_addstr(reply, state);
-    alertMtx.lock();
-    fty_proto_t* cursor = reinterpret_cast<fty_proto_t*>(zlistx_first(alerts));
-    while (cursor) {
-        if (is_state_included(state, fty_proto_state(cursor))) {
-            fty_proto_t* duplicate = fty_proto_dup(cursor);
-            zmsg_t*      result    = fty_proto_encode(&duplicate);
-
-            /* Note: the CZMQ_VERSION_MAJOR comparison below actually assumes versions
-             * we know and care about - v3.0.2 (our legacy default, already obsoleted
-             * by upstream), and v4.x that is in current upstream master. If the API
-             * evolves later (incompatibly), these macros will need to be amended.
-             */
-            zframe_t* frame = nullptr;
-            // FIXME: should we check and assert (nbytes>0) here, for both API versions,
-            // as we do in other similar cases?
-#if CZMQ_VERSION_MAJOR == 3
-            byte*  buffer = nullptr;
-            size_t nbytes = zmsg_encode(result, &buffer);
-            frame         = zframe_new(buffer, nbytes);
-            free(buffer);
-            buffer = nullptr;
-#else
-            frame = zmsg_encode(result);
-#endif
-            assert(frame);
-            zmsg_destroy(&result);
-            zmsg_append(reply, &frame);
-            // FIXME: Should we zframe_destroy (&frame) here as we do in other similar cases?
-        }
-        cursor = reinterpret_cast<fty_proto_t*>(zlistx_next(alerts));
-    }
-    alertMtx.unlock();
-
-    if (mlm_client_sendto(client, mlm_client_sender(client), RFC_ALERTS_LIST_SUBJECT, nullptr, 5000, &reply) != 0) {
-        log_error("mlm_client_sendto (sender = '%s', subject = '%s', timeout = '5000') failed.",
-            mlm_client_sender(client), RFC_ALERTS_LIST_SUBJECT);
+    for (Partition* part : partitions) {
+        std::shared_ptr<const Snapshot> snapshot = s_snapshot(*part);
+        if (!snapshot)
+            continue;
+        for (const auto& chunk : snapshot->chunks) {
+            for (const auto& entry : *chunk) {
+                if (is_state_included(state, entry->state.c_str())) {
+                    zframe_t* frame = zframe_new(entry->encoded.data(), entry->encoded.size());
+                    assert(frame);
+                    zmsg_append(reply, &frame);
+                }
+            }
+        }
     }
+
+    if (mlm_client_sendto(client, sender, RFC_ALERTS_LIST_SUBJECT, nullptr, 5000, &reply) != 0) {
+        log_error("mlm_client_sendto (sender = '%s', subject = '%s', timeout = '5000') failed.", sender,
+            RFC_ALERTS_LIST_SUBJECT);
+    }
+    alert_histogram_record(metrics.listLatency, uint64_t(zclock_usecs() - started));
     free(correlation_id);
     correlation_id = nullptr;
     free(state);
     state = nullptr;
 }
 
-static void s_handle_rfc_alerts_acknowledge(mlm_client_t* client, zmsg_t** msg_p)
+// acknowledgement requested from the mailbox, until it is committed
+struct PendingAck
 {
-    assert(client);
-    assert(msg_p);
-    assert(alerts);
+    std::string sender;
+    std::string rule;
+    std::string element;
+    std::string state;
+    uint64_t    seq = 0;      // request to the stream worker owning the alert
+    std::string result;       // answer of the worker, empty until received
+    uint64_t    time     = 0; // of the acknowledged alert
+    int64_t     received = 0; // request (zclock_usecs())
+};
+
+static std::string s_history_path()
+{
+    return statePath + "/" + HISTORY_DIR;
+}
 
-    zmsg_t* msg = *msg_p;
-    if (!msg) {
-        return;
+// part of a paged answer (ACTIVITY, HISTORY), items are added until it is sent
+struct PagedReply
+{
+    mlm_client_t* client        = nullptr;
+    const char*   subject       = nullptr;
+    const char*   command       = nullptr;
+    const char*   sender        = nullptr;
+    const char*   correlationId = nullptr;
+    zmsg_t*       msg           = nullptr;
+    size_t        count         = 0; // items in 'msg'
+};
+
+// send 'reply' ('more' - other parts follow) and start the next part
+static void s_paged_send(PagedReply& reply, bool more)
+{
+    zmsg_pushstr(reply.msg, more ? "1" : "0");
+    zmsg_pushstr(reply.msg, reply.correlationId);
+    zmsg_pushstr(reply.msg, reply.command);
+    if (mlm_client_sendto(reply.client, reply.sender, reply.subject, nullptr, 5000, &reply.msg) != 0) {
+        zmsg_destroy(&reply.msg);
+        log_error("mlm_client_sendto (sender = '%s', subject = '%s', timeout = '5000') failed.", reply.sender,
+            reply.subject);
     }
+    reply.msg   = zmsg_new();
+    reply.count = 0;
+}
 
-    char* rule = zmsg_popstr(msg);
-    if (!rule) {
-        zmsg_destroy(&msg);
+// HISTORY/correlation_id/from/to[/element] - resolved alerts of the history with time in
+// ['from', 'to'] (of 'element' only)
+static void s_handle_rfc_alerts_history(mlm_client_t* client, zmsg_t** msg_p)
+{
+    assert(client);
+    assert(msg_p && *msg_p);
+
+    zmsg_t* msg            = *msg_p;
+    char*   command        = zmsg_popstr(msg);
+    char*   correlation_id = zmsg_popstr(msg);
+    char*   from           = zmsg_popstr(msg);
+    char*   to             = zmsg_popstr(msg);
+    char*   element        = zmsg_popstr(msg);
+    zmsg_destroy(msg_p);
+
+    if (!command || !streq(command, "HISTORY") || !correlation_id || !from || !to) {
         std::string err = TRANSLATE_ME("BAD_MESSAGE");
-        s_send_error_response(client, RFC_ALERTS_ACKNOWLEDGE_SUBJECT, err.c_str());
-        return;
+        s_send_error_response(client, RFC_ALERTS_HISTORY_SUBJECT, err.c_str());
+    } else {
+        PagedReply reply;
+        reply.client        = client;
+        reply.subject       = RFC_ALERTS_HISTORY_SUBJECT;
+        reply.command       = "HISTORY";
+        reply.sender        = mlm_client_sender(client);
+        reply.correlationId = correlation_id;
+        reply.msg           = zmsg_new();
+
+        int rv = alert_history_query(s_history_path().c_str(), strtoull(from, nullptr, 10),
+            strtoull(to, nullptr, 10), element, [&](fty_proto_t* alert) {
+                if (reply.count == HISTORY_CHUNK)
+                    s_paged_send(reply, true);
+                std::string encoded = alert_encode_frame(alert);
+                zmsg_addmem(reply.msg, encoded.data(), encoded.size());
+                reply.count++;
+                return true;
+            });
+        log_debug("alert_history_query () == %d", rv);
+        s_paged_send(reply, false);
+        zmsg_destroy(&reply.msg);
     }
-    char* element = zmsg_popstr(msg);
-    if (!element) {
-        zstr_free(&rule);
-        zmsg_destroy(&msg);
-        std::string err = TRANSLATE_ME("BAD_MESSAGE");
-        s_send_error_response(client, RFC_ALERTS_ACKNOWLEDGE_SUBJECT, err.c_str());
+    zstr_free(&command);
+    zstr_free(&correlation_id);
+    zstr_free(&from);
+    zstr_free(&to);
+    zstr_free(&element);
+}
+
+static void s_activity_add(PagedReply& reply, uint64_t start, uint64_t end, const std::string& rule,
+    const std::string& element, const std::string& severity)
+{
+    if (reply.count == ACTIVITY_CHUNK)
+        s_paged_send(reply, true);
+    zmsg_addstr(reply.msg, rule.c_str());
+    zmsg_addstr(reply.msg, element.c_str());
+    zmsg_addstr(reply.msg, severity.c_str());
+    zmsg_addstrf(reply.msg, "%" PRIu64, start);
+    if (end)
+        zmsg_addstrf(reply.msg, "%" PRIu64, end);
+    else
+        zmsg_addstr(reply.msg, "");
+    reply.count++;
+}
+
+// ACTIVITY/correlation_id/from/to[/element] - periods alerts (of 'element' only) were active
+// (not RESOLVED) overlapping ['from', 'to']: ended ones from the activity log, then those
+// still going on from the snapshots
+static void s_handle_rfc_alerts_activity(mlm_client_t* client, const char* sender, zmsg_t** msg_p)
+{
+    assert(client);
+    assert(msg_p && *msg_p);
+
+    zmsg_t* msg            = *msg_p;
+    char*   command        = zmsg_popstr(msg);
+    char*   correlation_id = zmsg_popstr(msg);
+    char*   from           = zmsg_popstr(msg);
+    char*   to             = zmsg_popstr(msg);
+    char*   element        = zmsg_popstr(msg);
+    zmsg_destroy(msg_p);
+
+    uint64_t begin = from ? strtoull(from, nullptr, 10) : 0;
+    uint64_t end   = to ? strtoull(to, nullptr, 10) : 0;
+    if (!command || !streq(command, "ACTIVITY") || !correlation_id || !from || !to || begin > end) {
+        std::string err = TRANSLATE_ME("BAD_MESSAGE");
+        s_send_error_response(client, RFC_ALERTS_ACTIVITY_SUBJECT, err.c_str(), sender);
+    } else {
+        PagedReply reply;
+        reply.client        = client;
+        reply.subject       = RFC_ALERTS_ACTIVITY_SUBJECT;
+        reply.command       = "ACTIVITY";
+        reply.sender        = sender;
+        reply.correlationId = correlation_id;
+        reply.msg           = zmsg_new();
+
+        int rv = alert_activity_query(
+            statePath.c_str(), stateFile.c_str(), begin, end, element, [&](const AlertActivity& period) {
+                s_activity_add(reply, period.start, period.end, period.rule, period.element, period.severity);
+                return true;
+            });
+        log_debug("alert_activity_query () == %d", rv);
+
+        for (auto part : partitions) {
+            std::shared_ptr<const Snapshot> snapshot = s_snapshot(*part);
+            if (!snapshot)
+                continue;
+            for (const auto& chunk : snapshot->chunks) {
+                for (const auto& entry : *chunk) {
+                    if (entry->since && entry->since <= end
+                        && (!element || UTF8::utf8eq(entry->name.c_str(), element))) {
+                        s_activity_add(reply, entry->since, 0, entry->rule, entry->name, entry->severity);
+                    }
+                }
+            }
+        }
+        s_paged_send(reply, false);
+        zmsg_destroy(&reply.msg);
+    }
+    zstr_free(&command);
+    zstr_free(&correlation_id);
+    zstr_free(&from);
+    zstr_free(&to);
+    zstr_free(&element);
+}
+
+struct MetricValue
+{
+    std::string name;
+    uint64_t    value;
+    const char* unit;
+};
+
+// current metrics: counters since startup, size of the store and latency quantiles
+static std::vector<MetricValue> s_metrics()
+{
+    uint64_t stored = 0;
+    uint64_t active = 0;
+    for (Partition* part : partitions) {
+        std::shared_ptr<const Snapshot> snapshot = s_snapshot(*part);
+        if (!snapshot)
+            continue;
+        stored += snapshot->size;
+        for (const auto& chunk : snapshot->chunks) {
+            for (const auto& entry : *chunk) {
+                if (entry->state != "RESOLVED")
+                    active++;
+            }
+        }
+    }
+
+    std::vector<MetricValue> values = {
+        {"alerts.stored", stored, ""},
+        {"alerts.active", active, ""},
+        {"stream.delivered", metrics.delivered.load(std::memory_order_relaxed), ""},
+        {"stream.published", metrics.published.load(std::memory_order_relaxed), ""},
+        {"stream.ttl_resolved", metrics.ttlResolved.load(std::memory_order_relaxed), ""},
+        {"list.requests", metrics.lists.load(std::memory_order_relaxed), ""},
+        {"ack.requests", metrics.acks.load(std::memory_order_relaxed), ""},
+        {"ack.confirmed", metrics.acksConfirmed.load(std::memory_order_relaxed), ""},
+        {"ratelimit.suppressed", metrics.suppressed.load(std::memory_order_relaxed), ""},
+    };
+    const std::pair<const char*, const AlertHistogram*> histograms[] = {
+        {"stream.deliver_latency", &metrics.deliverLatency},
+        {"list.latency", &metrics.listLatency},
+        {"ack.latency", &metrics.ackLatency},
+    };
+    for (const auto& it : histograms) {
+        std::string name = it.first;
+        values.push_back({name + ".p50", alert_histogram_quantile(*it.second, 0.5), "us"});
+        values.push_back({name + ".p99", alert_histogram_quantile(*it.second, 0.99), "us"});
+        values.push_back({name + ".max", it.second->max.load(std::memory_order_relaxed), "us"});
+    }
+    return values;
+}
+
+// METRICS/correlation_id - current metrics of the agent
+static void s_handle_rfc_alerts_metrics(mlm_client_t* client, zmsg_t** msg_p)
+{
+    assert(client);
+    assert(msg_p && *msg_p);
+
+    zmsg_t* msg            = *msg_p;
+    char*   command        = zmsg_popstr(msg);
+    char*   correlation_id = zmsg_popstr(msg);
+    zmsg_destroy(msg_p);
+
+    if (!command || !streq(command, "METRICS") || !correlation_id) {
+        std::string err = TRANSLATE_ME("BAD_MESSAGE");
+        s_send_error_response(client, RFC_ALERTS_METRICS_SUBJECT, err.c_str());
+    } else {
+        zmsg_t* reply = zmsg_new();
+        zmsg_addstr(reply, "METRICS");
+        zmsg_addstr(reply, correlation_id);
+        for (const auto& metric : s_metrics()) {
+            zmsg_addstr(reply, metric.name.c_str());
+            zmsg_addstrf(reply, "%" PRIu64, metric.value);
+        }
+        if (mlm_client_sendto(client, mlm_client_sender(client), RFC_ALERTS_METRICS_SUBJECT, nullptr, 5000, &reply)
+            != 0) {
+            zmsg_destroy(&reply);
+            log_error("mlm_client_sendto (sender = '%s', subject = '%s', timeout = '5000') failed.",
+                mlm_client_sender(client), RFC_ALERTS_METRICS_SUBJECT);
+        }
+    }
+    zstr_free(&command);
+    zstr_free(&correlation_id);
+}
+
+// publish current metrics on METRICS, valid for 'ttl' s
+// (type: fty-alert-list.<metric>, element: fty-alert-list)
+static void s_publish_metrics(mlm_client_t* client, uint32_t ttl)
+{
+    uint64_t now = uint64_t(zclock_time() / 1000);
+    for (const auto& metric : s_metrics()) {
+        std::string type    = "fty-alert-list." + metric.name;
+        std::string value   = std::to_string(metric.value);
+        zmsg_t*     encoded = fty_proto_encode_metric(
+            nullptr, now, ttl, type.c_str(), "fty-alert-list", value.c_str(), metric.unit);
+        std::string subject = type + "@fty-alert-list";
+        if (!encoded || mlm_client_send(client, subject.c_str(), &encoded) != 0) {
+            zmsg_destroy(&encoded);
+            log_error("mlm_client_send (subject = '%s') failed", subject.c_str());
+        }
+    }
+}
+
+// partition a request is about (see s_request_partition())
+#define REQUEST_ALL  -1 // the whole store
+#define REQUEST_NONE -2 // no stored alert (answered from the disk or malformed)
+
+// request received before the partition it is about was restored, served once it is
+struct DeferredRequest
+{
+    std::string subject;
+    std::string sender;
+    zmsg_t*     msg       = nullptr;
+    int         partition = REQUEST_ALL;
+};
+
+// state owned by the mailbox actor
+struct MailboxContext
+{
+    std::vector<zsock_t*>       inboxes;               // of stream workers, by partition
+    zsock_t*                    replies     = nullptr; // answers of stream workers
+    zpoller_t*                  replyPoller = nullptr;
+    uint64_t                    seq         = 0;  // last request sent to a stream worker
+    std::vector<PendingAck>     acks;             // sent to the workers, not confirmed yet
+    int                         ackLog      = -1; // acknowledgement log, -1 - not logged
+    std::deque<DeferredRequest> deferred;         // by arrival
+};
+
+// wait for the answer of a stream worker to request 'seq', once the pending acknowledgements
+// are committed (their answers are consumed by s_ack_commit())
+// returns the answer following seq (to be destroyed by caller), NULL on timeout
+static zmsg_t* s_worker_reply(MailboxContext& ctx, uint64_t seq)
+{
+    while (zpoller_wait(ctx.replyPoller, 5000)) {
+        zmsg_t*  msg  = zmsg_recv(ctx.replies);
+        char*    rseq = zmsg_popstr(msg);
+        uint64_t got  = rseq ? strtoull(rseq, nullptr, 10) : 0;
+        zstr_free(&rseq);
+        if (got == seq)
+            return msg;
+        zmsg_destroy(&msg); // answer to a request given up on
+    }
+    log_error("stream worker did not answer request %" PRIu64, seq);
+    return nullptr;
+}
+
+// wait for the answers of the stream workers to the pending acknowledgements without a result
+// (requests of the batch are numbered consecutively)
+// returns the number of acknowledgements left unanswered
+static size_t s_ack_answers(MailboxContext& ctx)
+{
+    uint64_t first   = ctx.acks.front().seq;
+    size_t   waiting = 0;
+    for (const PendingAck& ack : ctx.acks) {
+        if (ack.result.empty())
+            waiting++;
+    }
+    while (waiting > 0 && zpoller_wait(ctx.replyPoller, 5000)) {
+        zmsg_t*  msg    = zmsg_recv(ctx.replies);
+        char*    rseq   = zmsg_popstr(msg);
+        char*    result = zmsg_popstr(msg);
+        char*    time   = zmsg_popstr(msg);
+        uint64_t got    = rseq ? strtoull(rseq, nullptr, 10) : 0;
+        // answers to requests given up on are dropped
+        if (got >= first && got - first < ctx.acks.size() && ctx.acks[got - first].result.empty()) {
+            PendingAck& ack = ctx.acks[got - first];
+            ack.result      = result ? result : "INTERNAL_ERROR";
+            ack.time        = time ? strtoull(time, nullptr, 10) : 0;
+            waiting--;
+        }
+        zstr_free(&rseq);
+        zstr_free(&result);
+        zstr_free(&time);
+        zmsg_destroy(&msg);
+    }
+    if (waiting > 0)
+        log_error("stream workers did not answer %zu acknowledgements", waiting);
+    return waiting;
+}
+
+// commit the pending acknowledgements: the workers check them, the accepted ones are logged
+// with one sync, then applied by the workers and confirmed; acknowledgements not logged are
+// answered with INTERNAL_ERROR and leave the alerts unchanged
+static void s_ack_commit(mlm_client_t* client, MailboxContext& ctx)
+{
+    if (ctx.acks.empty())
+        return;
+
+    s_ack_answers(ctx);
+    std::string batch;
+    for (const PendingAck& ack : ctx.acks) {
+        if (ack.result == "OK")
+            alert_ack_log_record(batch, ack.rule.c_str(), ack.element.c_str(), ack.state.c_str(), ack.time);
+    }
+    if (!batch.empty()) {
+        // log lost on a previous error is reopened
+        if (ctx.ackLog == -1)
+            ctx.ackLog = alert_ack_log_open(statePath.c_str(), stateFile.c_str());
+        // everything logged so far is saved in the state file
+        if (ctx.ackLog != -1 && acksSaved == acksLogged && lseek(ctx.ackLog, 0, SEEK_END) > 0 &&
+            ftruncate(ctx.ackLog, 0) != 0)
+            log_warning("cannot empty acknowledgement log: %s", strerror(errno));
+        off_t end = ctx.ackLog != -1 ? lseek(ctx.ackLog, 0, SEEK_END) : -1;
+        if (end != -1 && alert_journal_write(ctx.ackLog, batch) == 0) {
+            acksLogged++;
+        } else {
+            // nothing is applied, the requester can repeat them
+            log_error("acknowledgements not logged, not applied");
+            if (ctx.ackLog != -1) {
+                // a partial batch would end the replay before the batches appended later
+                if (end != -1 && ftruncate(ctx.ackLog, end) != 0)
+                    log_warning("cannot drop partial acknowledgement batch: %s", strerror(errno));
+                close(ctx.ackLog);
+                ctx.ackLog = -1;
+            }
+            for (PendingAck& ack : ctx.acks) {
+                if (ack.result == "OK")
+                    ack.result = "INTERNAL_ERROR";
+            }
+        }
+    }
+
+    // logged acknowledgements are applied by the workers, each answers once the snapshot
+    // holding its change is published
+    bool logged = false;
+    for (PendingAck& ack : ctx.acks) {
+        ack.seq = ++ctx.seq;
+        if (ack.result != "OK")
+            continue;
+        ack.result      = "";
+        logged          = true;
+        zmsg_t* request = zmsg_new();
+        zmsg_addstr(request, "ACKAPPLY");
+        zmsg_addstrf(request, "%" PRIu64, ack.seq);
+        zmsg_addstr(request, ack.rule.c_str());
+        zmsg_addstr(request, ack.element.c_str());
+        zmsg_addstr(request, ack.state.c_str());
+        zmsg_addstrf(request, "%" PRIu64, ack.time);
+        if (zmsg_send(&request, ctx.inboxes[s_partition(ack.rule.c_str(), ack.element.c_str()).id]) != 0)
+            zmsg_destroy(&request);
+    }
+    // the next checkpoint holds the batch once all of it is applied (a worker answers in
+    // order, batches given up on are covered by the next one answered)
+    if (logged && s_ack_answers(ctx) == 0)
+        acksApplied = acksLogged.load();
+
+    for (PendingAck& ack : ctx.acks) {
+        if (ack.result != "OK") {
+            s_send_error_response(client, RFC_ALERTS_ACKNOWLEDGE_SUBJECT,
+                ack.result.empty() ? "INTERNAL_ERROR" : ack.result.c_str(), ack.sender.c_str());
+            continue;
+        }
+        zmsg_t* reply = zmsg_new();
+        zmsg_addstr(reply, "OK");
+        zmsg_addstr(reply, ack.rule.c_str());
+        zmsg_addstr(reply, ack.element.c_str());
+        zmsg_addstr(reply, ack.state.c_str());
+
+        int rv = mlm_client_sendto(client, ack.sender.c_str(), RFC_ALERTS_ACKNOWLEDGE_SUBJECT, nullptr, 5000, &reply);
+        if (rv != 0) {
+            zmsg_destroy(&reply);
+            log_error("mlm_client_sendto (sender = '%s', subject = '%s', timeout = '5000') failed.",
+                ack.sender.c_str(), RFC_ALERTS_ACKNOWLEDGE_SUBJECT);
+        }
+        s_count(metrics.acksConfirmed);
+        alert_histogram_record(metrics.ackLatency, uint64_t(zclock_usecs() - ack.received));
+    }
+    ctx.acks.clear();
+}
+
+// the acknowledgement is checked by the worker owning the alert, it is logged, applied and
+// confirmed by s_ack_commit()
+static void s_handle_rfc_alerts_acknowledge(
+    mlm_client_t* client, MailboxContext& ctx, const char* sender, zmsg_t** msg_p)
+{
+    assert(client);
+    assert(msg_p);
+    assert(!partitions.empty());
+
+    zmsg_t* msg = *msg_p;
+    if (!msg) {
+        return;
+    }
+    int64_t received = zclock_usecs();
+    s_count(metrics.acks);
+
+    char* rule = zmsg_popstr(msg);
+    if (!rule) {
+        zmsg_destroy(&msg);
+        std::string err = TRANSLATE_ME("BAD_MESSAGE");
+        s_send_error_response(client, RFC_ALERTS_ACKNOWLEDGE_SUBJECT, err.c_str(), sender);
+        return;
+    }
+    char* element = zmsg_popstr(msg);
+    if (!element) {
+        zstr_free(&rule);
+        zmsg_destroy(&msg);
+        std::string err = TRANSLATE_ME("BAD_MESSAGE");
+        s_send_error_response(client, RFC_ALERTS_ACKNOWLEDGE_SUBJECT, err.c_str(), sender);
         return;
     }
     char* state = zmsg_popstr(msg);
@@ -424,7 +1789,7 @@ static void s_handle_rfc_alerts_acknowledge(mlm_client_t* client, zmsg_t** msg_p
         zstr_free(&element);
         zmsg_destroy(&msg);
         std::string err = TRANSLATE_ME("BAD_MESSAGE");
-        s_send_error_response(client, RFC_ALERTS_ACKNOWLEDGE_SUBJECT, err.c_str());
+        s_send_error_response(client, RFC_ALERTS_ACKNOWLEDGE_SUBJECT, err.c_str(), sender);
         return;
     }
     zmsg_destroy(&msg);
@@ -435,63 +1800,300 @@ static void s_handle_rfc_alerts_acknowledge(mlm_client_t* client, zmsg_t** msg_p
         zstr_free(&rule);
         zstr_free(&element);
         zstr_free(&state);
-        s_send_error_response(client, RFC_ALERTS_ACKNOWLEDGE_SUBJECT, "BAD_STATE");
+        s_send_error_response(client, RFC_ALERTS_ACKNOWLEDGE_SUBJECT, "BAD_STATE", sender);
         return;
     }
     log_debug("s_handle_rfc_alerts_acknowledge (): rule == '%s' element == '%s' state == '%s'", rule, element, state);
-    // check ('rule', 'element') pair
-    alertMtx.lock();
-    fty_proto_t* cursor = reinterpret_cast<fty_proto_t*>(zlistx_first(alerts));
-    int          found  = 0;
-    while (cursor) {
-        if (is_alert_identified(cursor, rule, element)) {
-            found = 1;
-            break;
+    // the alert is checked by the worker owning it
+    Partition& part    = s_partition(rule, element);
+    uint64_t   seq     = ++ctx.seq;
+    zmsg_t*    request = zmsg_new();
+    zmsg_addstr(request, "ACK");
+    zmsg_addstrf(request, "%" PRIu64, seq);
+    zmsg_addstr(request, rule);
+    zmsg_addstr(request, element);
+    zmsg_addstr(request, state);
+    if (zmsg_send(&request, ctx.inboxes[part.id]) != 0)
+        zmsg_destroy(&request);
+
+    PendingAck ack;
+    ack.sender   = sender;
+    ack.rule     = rule;
+    ack.element  = element;
+    ack.state    = state;
+    ack.seq      = seq;
+    ack.received = received;
+    ctx.acks.push_back(std::move(ack));
+    zstr_free(&rule);
+    zstr_free(&element);
+    zstr_free(&state);
+}
+
+// TRANSITIONS/correlation_id/rule/element - last transitions of an alert, asked to the worker owning it
+static void s_handle_rfc_alerts_transitions(
+    mlm_client_t* client, MailboxContext& ctx, const char* sender, zmsg_t** msg_p)
+{
+    assert(client);
+    assert(msg_p && *msg_p);
+
+    zmsg_t* msg            = *msg_p;
+    char*   command        = zmsg_popstr(msg);
+    char*   correlation_id = zmsg_popstr(msg);
+    char*   rule           = zmsg_popstr(msg);
+    char*   element        = zmsg_popstr(msg);
+    zmsg_destroy(msg_p);
+
+    zmsg_t* answer = nullptr;
+    if (command && streq(command, "TRANSITIONS") && correlation_id && rule && element) {
+        uint64_t seq     = ++ctx.seq;
+        zmsg_t*  request = zmsg_new();
+        zmsg_addstr(request, "TRANSITIONS");
+        zmsg_addstrf(request, "%" PRIu64, seq);
+        zmsg_addstr(request, rule);
+        zmsg_addstr(request, element);
+        if (zmsg_send(&request, ctx.inboxes[s_partition(rule, element).id]) != 0)
+            zmsg_destroy(&request);
+        answer = s_worker_reply(ctx, seq);
+    }
+
+    char* result = answer ? zmsg_popstr(answer) : nullptr;
+    if (!command || !streq(command, "TRANSITIONS") || !correlation_id || !rule || !element) {
+        std::string err = TRANSLATE_ME("BAD_MESSAGE");
+        s_send_error_response(client, RFC_ALERTS_TRANSITIONS_SUBJECT, err.c_str(), sender);
+    } else if (!result || !streq(result, "OK")) {
+        s_send_error_response(client, RFC_ALERTS_TRANSITIONS_SUBJECT, result ? result : "INTERNAL_ERROR", sender);
+    } else {
+        // the transitions follow as answered by the worker
+        zmsg_pushstr(answer, element);
+        zmsg_pushstr(answer, rule);
+        zmsg_pushstr(answer, correlation_id);
+        zmsg_pushstr(answer, "TRANSITIONS");
+        if (mlm_client_sendto(client, sender, RFC_ALERTS_TRANSITIONS_SUBJECT, nullptr, 5000, &answer) != 0) {
+            log_error("mlm_client_sendto (sender = '%s', subject = '%s', timeout = '5000') failed.", sender,
+                RFC_ALERTS_TRANSITIONS_SUBJECT);
         }
-        cursor = reinterpret_cast<fty_proto_t*>(zlistx_next(alerts));
     }
-    if (found == 0) {
-        zstr_free(&rule);
-        zstr_free(&element);
-        zstr_free(&state);
-        s_send_error_response(client, RFC_ALERTS_ACKNOWLEDGE_SUBJECT, "NOT_FOUND");
-        alertMtx.unlock();
+    zmsg_destroy(&answer);
+    zstr_free(&result);
+    zstr_free(&command);
+    zstr_free(&correlation_id);
+    zstr_free(&rule);
+    zstr_free(&element);
+}
+
+static void s_handle_mailbox_deliver(
+    mlm_client_t* client, MailboxContext& ctx, const char* subject, const char* sender, zmsg_t** msg_p)
+{
+    assert(client);
+    assert(msg_p && *msg_p);
+    assert(!partitions.empty());
+
+    // other requests are answered after the pending acknowledgements
+    if (!streq(subject, RFC_ALERTS_ACKNOWLEDGE_SUBJECT))
+        s_ack_commit(client, ctx);
+
+    if (streq(subject, RFC_ALERTS_LIST_SUBJECT)) {
+        s_handle_rfc_alerts_list(client, sender, msg_p);
+    } else if (streq(subject, RFC_ALERTS_ACKNOWLEDGE_SUBJECT)) {
+        s_handle_rfc_alerts_acknowledge(client, ctx, sender, msg_p);
+    } else if (streq(subject, RFC_ALERTS_HISTORY_SUBJECT)) {
+        s_handle_rfc_alerts_history(client, msg_p);
+    } else if (streq(subject, RFC_ALERTS_TRANSITIONS_SUBJECT)) {
+        s_handle_rfc_alerts_transitions(client, ctx, sender, msg_p);
+    } else if (streq(subject, RFC_ALERTS_ACTIVITY_SUBJECT)) {
+        s_handle_rfc_alerts_activity(client, sender, msg_p);
+    } else if (streq(subject, RFC_ALERTS_METRICS_SUBJECT)) {
+        s_handle_rfc_alerts_metrics(client, msg_p);
+    } else {
+        std::string err = TRANSLATE_ME("UNKNOWN_PROTOCOL");
+        s_send_error_response(client, subject, err.c_str(), sender);
+        log_error("Unknown protocol. Subject: '%s', Sender: '%s'.", subject, sender);
+        zmsg_destroy(msg_p);
+    }
+}
+
+// partition holding the alert request 'msg' of 'subject' is about, REQUEST_ALL if it reads
+// the whole store (LIST, ongoing periods of ACTIVITY), REQUEST_NONE if none
+static int s_request_partition(const char* subject, zmsg_t* msg)
+{
+    size_t skip = 0; // frames before rule and element
+    if (streq(subject, RFC_ALERTS_LIST_SUBJECT) || streq(subject, RFC_ALERTS_ACTIVITY_SUBJECT))
+        return REQUEST_ALL;
+    else if (streq(subject, RFC_ALERTS_ACKNOWLEDGE_SUBJECT))
+        skip = 0;
+    else if (streq(subject, RFC_ALERTS_TRANSITIONS_SUBJECT))
+        skip = 2;
+    else
+        return REQUEST_NONE;
+
+    zframe_t* frame = zmsg_first(msg);
+    for (; frame && skip > 0; skip--)
+        frame = zmsg_next(msg);
+    zframe_t* next = frame ? zmsg_next(msg) : nullptr;
+    if (!next)
+        return REQUEST_NONE;
+    char* rule      = zframe_strdup(frame);
+    char* element   = zframe_strdup(next);
+    int   partition = int(s_partition(rule, element).id);
+    zstr_free(&rule);
+    zstr_free(&element);
+    return partition;
+}
+
+// can a request about 'partition' be served now: it is restored, and no request about it
+// received before waits
+static bool s_request_ready(const MailboxContext& ctx, int partition)
+{
+    if (partition == REQUEST_NONE)
+        return true;
+    for (const DeferredRequest& request : ctx.deferred) {
+        if (partition == REQUEST_ALL || request.partition == partition)
+            return false;
+    }
+    return partition == REQUEST_ALL ? loading == 0 : partitions[size_t(partition)]->loaded.load();
+}
+
+// serve request 'msg' just received, unless the partition it is about is not restored yet:
+// it is then deferred (other requests are served meanwhile)
+static void s_handle_mailbox_request(mlm_client_t* client, MailboxContext& ctx, zmsg_t** msg_p)
+{
+    int partition = s_request_partition(mlm_client_subject(client), *msg_p);
+    if (s_request_ready(ctx, partition)) {
+        s_handle_mailbox_deliver(client, ctx, mlm_client_subject(client), mlm_client_sender(client), msg_p);
         return;
     }
-    if (streq(fty_proto_state(cursor), "RESOLVED")) {
+    DeferredRequest request;
+    request.subject   = mlm_client_subject(client);
+    request.sender    = mlm_client_sender(client);
+    request.msg       = *msg_p;
+    request.partition = partition;
+    ctx.deferred.push_back(std::move(request));
+    *msg_p = nullptr;
+}
+
+// serve the deferred requests whose partitions are restored now, by arrival
+static void s_serve_deferred(mlm_client_t* client, MailboxContext& ctx)
+{
+    std::deque<DeferredRequest> waiting;
+    waiting.swap(ctx.deferred);
+    for (DeferredRequest& request : waiting) {
+        if (s_request_ready(ctx, request.partition))
+            s_handle_mailbox_deliver(client, ctx, request.subject.c_str(), request.sender.c_str(), &request.msg);
+        else
+            ctx.deferred.push_back(std::move(request));
+    }
+    s_ack_commit(client, ctx);
+}
+
+// handle configuration command forwarded by the stream actor
+static void s_stream_command(StreamContext& ctx, const char* cmd, zmsg_t* msg)
+{
+    if (streq(cmd, "TTLCLEANUP")) {
+        // kept for compatibility, expired alerts are resolved as their deadline passes
+        s_resolve_expired_alerts(ctx);
+    } else if (streq(cmd, "RATELIMIT")) {
+        // RATELIMIT/global|rule/rate/burst - token bucket of publications (rate 0 - unlimited)
+        char* scope = zmsg_popstr(msg);
+        char* rate  = zmsg_popstr(msg);
+        char* burst = zmsg_popstr(msg);
+        if (scope && rate && burst && streq(scope, "global")) {
+            s_global_rate_set(atof(rate), std::max(1.0, atof(burst)));
+        } else if (scope && rate && burst && streq(scope, "rule")) {
+            ctx.ruleLimit.rate  = atof(rate);
+            ctx.ruleLimit.burst = std::max(1.0, atof(burst));
+        } else {
+            log_error("RATELIMIT: bad arguments");
+        }
+        if (scope && rate && burst && ctx.part->id == 0)
+            log_debug("%s rate limit set to %s msg/s (burst %s)", scope, rate, burst);
+        zstr_free(&scope);
+        zstr_free(&rate);
+        zstr_free(&burst);
+    } else if (streq(cmd, "FLAPPING")) {
+        // FLAPPING/rule/window - debounce window (ms) of rule, '*' for the default one
+        char* rule   = zmsg_popstr(msg);
+        char* window = zmsg_popstr(msg);
+        if (rule && window) {
+            if (streq(rule, "*"))
+                ctx.flapWindow = atoll(window);
+            else
+                ctx.flapWindows[rule] = atoll(window);
+            if (ctx.part->id == 0)
+                log_debug("flapping window of '%s' set to %s ms", rule, window);
+        } else {
+            log_error("FLAPPING: missing rule or window");
+        }
+        zstr_free(&rule);
+        zstr_free(&window);
+    } else {
+        log_warning("unknown stream command '%s'", cmd);
+    }
+}
+
+// ACK/seq/rule/element/state - acknowledgement checked for the mailbox actor, the alert is
+// left unchanged until the acknowledgement is logged
+// ACKAPPLY/seq/rule/element/state/time - acknowledgement logged by the mailbox actor, applied
+// to the alert unless it was resolved or raised again since (as on replay of the log)
+// both are answered with seq/result/time (result OK, NOT_FOUND or BAD_STATE, time of the alert)
+static void s_stream_acknowledge(StreamContext& ctx, zmsg_t* msg, bool apply)
+{
+    char* seq     = zmsg_popstr(msg);
+    char* rule    = zmsg_popstr(msg);
+    char* element = zmsg_popstr(msg);
+    char* state   = zmsg_popstr(msg);
+    char* logged  = apply ? zmsg_popstr(msg) : nullptr;
+    if (!seq || !rule || !element || !state || (apply && !logged)) {
+        log_error("%s: bad arguments", apply ? "ACKAPPLY" : "ACK");
+        if (seq)
+            zstr_sendx(ctx.replies, seq, "BAD_MESSAGE", nullptr);
+        zstr_free(&seq);
         zstr_free(&rule);
         zstr_free(&element);
         zstr_free(&state);
-        s_send_error_response(client, RFC_ALERTS_ACKNOWLEDGE_SUBJECT, "BAD_STATE");
-        alertMtx.unlock();
+        zstr_free(&logged);
         return;
     }
-    // change stored alert state, don't change timestamp
-    log_debug("s_handle_rfc_alerts_acknowledge (): Changing state of (%s, %s) to %s", fty_proto_rule(cursor),
-        fty_proto_name(cursor), state);
-    fty_proto_set_state(cursor, "%s", state);
 
+    // check ('rule', 'element') pair, as delivered before the request
+    s_ingest_flush(ctx, rule, element);
+    Partition&   part   = *ctx.part;
+    fty_proto_t* cursor = s_find_alert(part, rule, element);
+    const char*  result = "OK";
+    uint64_t     time   = 0;
+    if (!cursor) {
+        result = "NOT_FOUND";
+    } else if (streq(fty_proto_state(cursor), "RESOLVED") ||
+               (apply && fty_proto_time(cursor) != strtoull(logged, nullptr, 10))) {
+        result = "BAD_STATE";
+    } else {
+        time = fty_proto_time(cursor);
+    }
+    if (apply && cursor && streq(result, "OK")) {
+        // change stored alert state, don't change timestamp
+        log_debug("s_handle_rfc_alerts_acknowledge (): Changing state of (%s, %s) to %s", fty_proto_rule(cursor),
+            fty_proto_name(cursor), state);
+        uint8_t from = s_state_code(fty_proto_state(cursor));
+        fty_proto_set_state(cursor, "%s", state);
+        s_record_transition(part, cursor, from, TRANSITION_ACKNOWLEDGE);
+        s_touch_alert(part, cursor, ALERT_JOURNAL_ACK);
+    }
     zmsg_t* reply = zmsg_new();
-    zmsg_addstr(reply, "OK");
-    zmsg_addstr(reply, rule);
-    zmsg_addstr(reply, element);
-    zmsg_addstr(reply, state);
-
-    char* subject =
-        zsys_sprintf("%s/%s@%s", fty_proto_rule(cursor), fty_proto_severity(cursor), fty_proto_name(cursor));
+    zmsg_addstr(reply, seq);
+    zmsg_addstr(reply, result);
+    zmsg_addstrf(reply, "%" PRIu64, time);
+    s_outbox_reply(ctx, reply);
+    zstr_free(&seq);
     zstr_free(&rule);
     zstr_free(&element);
     zstr_free(&state);
+    zstr_free(&logged);
+    if (!apply || !streq(result, "OK"))
+        return;
 
-    int rv = mlm_client_sendto(client, mlm_client_sender(client), RFC_ALERTS_ACKNOWLEDGE_SUBJECT, nullptr, 5000, &reply);
-    if (rv != 0) {
-        zmsg_destroy(&reply);
-        log_error("mlm_client_sendto (sender = '%s', subject = '%s', timeout = '5000') failed.",
-            mlm_client_sender(client), RFC_ALERTS_ACKNOWLEDGE_SUBJECT);
-    }
+    char* subject =
+        zsys_sprintf("%s/%s@%s", fty_proto_rule(cursor), fty_proto_severity(cursor), fty_proto_name(cursor));
     if (!subject) {
         log_error("zsys_sprintf () failed");
-        alertMtx.unlock();
         return;
     }
     uint64_t     timestamp = uint64_t(zclock_time() / 1000);
@@ -499,58 +2101,485 @@ static void s_handle_rfc_alerts_acknowledge(mlm_client_t* client, zmsg_t** msg_p
     if (!copy) {
         log_error("fty_proto_dup () failed");
         zstr_free(&subject);
-        alertMtx.unlock();
         return;
     }
-    alertMtx.unlock();
 
     fty_proto_set_time(copy, timestamp);
-    reply = fty_proto_encode(&copy);
-    if (!reply) {
+    zmsg_t* published = fty_proto_encode(&copy);
+    if (!published) {
         log_error("fty_proto_encode () failed");
         fty_proto_destroy(&copy);
         zstr_free(&subject);
         return;
     }
-    rv = mlm_client_send(client, subject, &reply);
-    if (rv != 0) {
+    s_outbox_publish(ctx, subject, published);
+    zstr_free(&subject);
+}
+
+// TRANSITIONS/seq/rule/element - last transitions of an alert requested by the mailbox actor,
+// answered with seq/result (OK or NOT_FOUND) and time/from/to/severity/source of each
+// transition, the oldest first
+static void s_stream_transitions(StreamContext& ctx, zmsg_t* msg)
+{
+    char* seq     = zmsg_popstr(msg);
+    char* rule    = zmsg_popstr(msg);
+    char* element = zmsg_popstr(msg);
+    if (rule && element)
+        s_ingest_flush(ctx, rule, element);
+
+    fty_proto_t* cursor = seq && rule && element ? s_find_alert(*ctx.part, rule, element) : nullptr;
+    zmsg_t*      reply  = zmsg_new();
+    zmsg_addstr(reply, seq ? seq : "0");
+    zmsg_addstr(reply, cursor ? "OK" : "NOT_FOUND");
+    if (cursor) {
+        const AlertInfo& info  = ctx.part->info[cursor];
+        uint64_t         count = std::min<uint64_t>(info.transitionCount, TRANSITION_HISTORY);
+        for (uint64_t i = info.transitionCount - count; i < info.transitionCount; i++) {
+            const Transition& transition = info.transitions[i % TRANSITION_HISTORY];
+            zmsg_addstrf(reply, "%" PRIu64, transition.time);
+            zmsg_addstr(reply, TRANSITION_STATES[transition.from]);
+            zmsg_addstr(reply, TRANSITION_STATES[transition.to]);
+            zmsg_addstr(reply, transition.severity);
+            zmsg_addstr(reply, TRANSITION_SOURCES[transition.source]);
+        }
+    }
+    if (zmsg_send(&reply, ctx.replies) != 0)
         zmsg_destroy(&reply);
-        log_error("mlm_client_send (subject = '%s') failed", subject);
+    zstr_free(&seq);
+    zstr_free(&rule);
+    zstr_free(&element);
+}
+
+// remove stored 'alert' and its deadlines from the store
+static void s_purge_alert(StreamContext& ctx, fty_proto_t* alert)
+{
+    Partition& part = *ctx.part;
+    AlertInfo& info = part.info[alert];
+    if (info.expires)
+        ctx.expirations.erase(std::make_pair(info.expires, alert));
+    if (info.refresh)
+        ctx.refreshes.erase(std::make_pair(info.refresh, alert));
+    if (info.settle)
+        ctx.settles.erase(std::make_pair(info.settle, alert));
+    // left in ctx.pending, skipped there once its information is gone
+    // its publications queued already are still sent
+    for (Outgoing& out : ctx.outbox) {
+        if (out.alert == alert)
+            out.alert = nullptr;
     }
-    zstr_free(&subject);
+
+    auto range = part.index.equal_range(alert_id_key(fty_proto_rule(alert), fty_proto_name(alert)));
+    for (auto it = range.first; it != range.second; ++it) {
+        if (it->second == alert) {
+            part.index.erase(it);
+            break;
+        }
+    }
+    part.purged.push_back(info.snap ? info.snap : s_snapshot_entry(alert, info));
+    part.slots[info.slot] = nullptr;
+    part.removed++;
+    part.changedChunks.insert(info.slot / SNAPSHOT_CHUNK);
+    void* handle = info.handle;
+    part.info.erase(alert);
+    zlistx_delete(part.alerts, handle);
+    part.dirty = true;
+    changes++;
 }
 
-static void s_handle_mailbox_deliver(mlm_client_t* client, zmsg_t** msg_p)
+// PURGE/rule/element/time[/rule/element/time]... - RESOLVED alerts to purge by the retention
+// policy, unless they changed since (see s_retention_sweep())
+// a tombstone of each purged alert is published on ALERTS: its last copy with auxiliary
+// flag 'purged' set to 1
+static void s_stream_purge(StreamContext& ctx, zmsg_t* msg)
 {
-    assert(client);
-    assert(msg_p && *msg_p);
-    assert(alerts);
+    std::vector<fty_proto_t*> tombstones;
+    while (zmsg_size(msg) >= 3) {
+        char* rule    = zmsg_popstr(msg);
+        char* element = zmsg_popstr(msg);
+        char* time    = zmsg_popstr(msg);
+
+        s_ingest_flush(ctx, rule, element);
+        fty_proto_t* cursor = s_find_alert(*ctx.part, rule, element);
+        if (cursor && streq(fty_proto_state(cursor), "RESOLVED")
+            && fty_proto_time(cursor) == strtoull(time, nullptr, 10)) {
+            fty_proto_t* tombstone = fty_proto_dup(cursor);
+            if (tombstone) {
+                fty_proto_aux_insert(tombstone, "purged", "%s", "1");
+                tombstones.push_back(tombstone);
+            }
+            s_purge_alert(ctx, cursor);
+        }
+        zstr_free(&rule);
+        zstr_free(&element);
+        zstr_free(&time);
+    }
+    log_debug("partition %zu: %zu resolved alerts purged", ctx.part->id, tombstones.size());
 
-    if (streq(mlm_client_subject(client), RFC_ALERTS_LIST_SUBJECT)) {
-        s_handle_rfc_alerts_list(client, msg_p);
-    } else if (streq(mlm_client_subject(client), RFC_ALERTS_ACKNOWLEDGE_SUBJECT)) {
-        s_handle_rfc_alerts_acknowledge(client, msg_p);
-    } else {
-        std::string err = TRANSLATE_ME("UNKNOWN_PROTOCOL");
-        s_send_error_response(client, mlm_client_subject(client), err.c_str());
-        log_error(
-            "Unknown protocol. Subject: '%s', Sender: '%s'.", mlm_client_subject(client), mlm_client_sender(client));
-        zmsg_destroy(msg_p);
+    for (fty_proto_t*& tombstone : tombstones) {
+        char* subject = zsys_sprintf(
+            "%s/%s@%s", fty_proto_rule(tombstone), fty_proto_severity(tombstone), fty_proto_name(tombstone));
+        s_outbox_publish(ctx, subject, fty_proto_encode(&tombstone));
+        zstr_free(&subject);
+    }
+}
+
+// take over the alerts of the partition loaded from the state file
+static void s_stream_restore(StreamContext& ctx)
+{
+    Partition& part     = *ctx.part;
+    zlistx_t*  restored = part.restored.exchange(nullptr);
+    if (!restored)
+        return;
+
+    fty_proto_t* cursor = reinterpret_cast<fty_proto_t*>(zlistx_first(restored));
+    while (cursor) {
+        fty_proto_t* stored = s_store_alert(part, cursor);
+        AlertInfo&   info   = part.info[stored];
+        // active since its creation as far as known (severity changes reset it)
+        if (!streq(fty_proto_state(stored), "RESOLVED"))
+            info.activeSince = fty_proto_aux_number(stored, "ctime", fty_proto_time(stored));
+        // already in the state file or the journal, not journaled again
+        info.snap = s_snapshot_entry(stored, info);
+        cursor    = reinterpret_cast<fty_proto_t*>(zlistx_next(restored));
     }
+    log_debug("partition %zu: %zu alerts restored, %zu deliveries queued meanwhile", part.id,
+        zlistx_size(restored), ctx.ingest.size);
+    zlistx_destroy(&restored);
+
+    s_publish_snapshot(part);
+    ctx.loaded  = true;
+    part.loaded = true;
+    loading--;
 }
 
+struct WorkerArgs
+{
+    const char* endpoint;
+    Partition*  part;
+};
+
+// stream worker: applies deliveries to its partition of the store, serves its deadlines
+// and publishes on ALERTS
+static void s_stream_worker(zsock_t* pipe, void* args)
+{
+    WorkerArgs*   wargs = reinterpret_cast<WorkerArgs*>(args);
+    StreamContext ctx;
+    ctx.part = wargs->part;
+
+    zsock_t* inbox = zsock_new_pull(("@" + ctx.part->inbox).c_str());
+    assert(inbox);
+    ctx.replies = zsock_new_push((">" + repliesEndpoint).c_str());
+    assert(ctx.replies);
+    if (journaling)
+        ctx.part->journal = zsock_new_push((">" + journalEndpoint).c_str());
+
+    char*         name   = zsys_sprintf("fty-alert-list-stream-%zu", ctx.part->id);
+    mlm_client_t* client = mlm_client_new();
+    mlm_client_connect(client, wargs->endpoint, 1000, name);
+    mlm_client_set_producer(client, "ALERTS");
+    zstr_free(&name);
+
+    zpoller_t* poller = zpoller_new(pipe, inbox, nullptr);
+    zpoller_t* paused = zpoller_new(pipe, nullptr); // ingest queue full, the inbox is left as is
+    zsock_signal(pipe, 0);
+
+    while (!zsys_interrupted) {
+
+        bool  full  = ctx.ingest.size >= INGEST_QUEUE_SIZE;
+        void* which = zpoller_wait(full ? paused : poller, s_stream_timeout(ctx, 1000));
+
+        if (!ctx.loaded)
+            s_stream_restore(ctx);
+
+        // deadlines are served from this loop, whatever woke it up
+        s_resolve_expired_alerts(ctx);
+        s_settle_flapping_alerts(ctx);
+        s_refresh_alerts(ctx);
+        if (!ctx.pending.empty())
+            s_publish_pending_alerts(ctx);
+
+        if (which == pipe) {
+            char* cmd = zstr_recv(pipe);
+            bool  term = cmd && streq(cmd, "$TERM");
+            zstr_free(&cmd);
+            if (term)
+                break;
+        } else if (which == inbox) {
+            if (s_ingest_receive(inbox, ctx) == -1)
+                break;
+        }
+
+        s_ingest_process(ctx, INGEST_BATCH);
+        s_stream_flush(client, ctx);
+    }
+
+    // drop deliveries not applied yet
+    alert_ingest_clear(ctx.ingest);
+    for (Outgoing& out : ctx.outbox)
+        zmsg_destroy(&out.msg);
+    while (zsock_events(inbox) & ZMQ_POLLIN) {
+        zmsg_t* msg = zmsg_recv(inbox);
+        char*   cmd = zmsg_popstr(msg);
+        if (cmd && streq(cmd, "DELIVER")) {
+            zframe_t*    frame = zmsg_last(msg);
+            fty_proto_t* alert = nullptr;
+            if (frame && zframe_size(frame) == sizeof(alert))
+                memcpy(&alert, zframe_data(frame), sizeof(alert));
+            fty_proto_destroy(&alert);
+        }
+        zstr_free(&cmd);
+        zmsg_destroy(&msg);
+    }
+
+    mlm_client_destroy(&client);
+    zpoller_destroy(&paused);
+    zpoller_destroy(&poller);
+    zsock_destroy(&inbox);
+    zsock_destroy(&ctx.replies);
+    zsock_destroy(&ctx.part->journal);
+}
+
+// hand decoded 'alert' over to the worker owning its partition (takes ownership)
+static void s_stream_dispatch(std::vector<zsock_t*>& inboxes, const char* subject, fty_proto_t* alert)
+{
+    Partition& part = s_partition(fty_proto_rule(alert), fty_proto_name(alert));
+
+    zmsg_t* msg = zmsg_new();
+    zmsg_addstr(msg, "DELIVER");
+    zmsg_addstr(msg, subject ? subject : "");
+    zmsg_addmem(msg, &alert, sizeof(alert));
+    if (zmsg_send(&msg, inboxes[part.id]) != 0) {
+        log_error("delivery to stream worker %zu failed", part.id);
+        zmsg_destroy(&msg);
+        fty_proto_destroy(&alert);
+    }
+}
+
+// retention policy of RESOLVED alerts, 0 - unlimited
+struct Retention
+{
+    uint64_t age     = 0; // s since the alert was resolved
+    size_t   count   = 0; // RESOLVED alerts in the store
+    size_t   element = 0; // RESOLVED alerts of one element
+    uint64_t history = 0; // s since the alert was resolved before it moves to the history, 0 - no history
+};
+
+// counts by element name, names sharing a key (see alert_element_key()) are told apart by
+// UTF8::utf8eq()
+using ElementCounts = std::unordered_multimap<std::string, std::pair<const char*, size_t>>;
+
+// count of 'element' in 'counts', added with 0 if missing ('element' must outlive 'counts')
+static size_t& s_element_count(ElementCounts& counts, const char* element)
+{
+    std::string key   = alert_element_key(element);
+    auto        range = counts.equal_range(key);
+    for (auto it = range.first; it != range.second; ++it) {
+        if (UTF8::utf8eq(it->second.first, element))
+            return it->second.second;
+    }
+    return counts.emplace(key, std::make_pair(element, size_t(0)))->second.second;
+}
+
+// find RESOLVED alerts beyond the retention policy in the published snapshots, the oldest
+// ones first, and send them to the workers owning them to be purged
+// (with a history, they are written to it first: nothing is purged unless written)
+static void s_retention_sweep(std::vector<zsock_t*>& inboxes, const Retention& retention)
+{
+    if ((!retention.age && !retention.count && !retention.element && !retention.history) || loading != 0)
+        return;
+
+    std::vector<std::shared_ptr<const Snapshot>>             published;
+    std::vector<std::pair<const SnapshotEntry*, Partition*>> resolved;
+    for (Partition* part : partitions) {
+        published.push_back(s_snapshot(*part));
+        if (!published.back())
+            continue;
+        for (const auto& chunk : published.back()->chunks) {
+            for (const auto& entry : *chunk) {
+                if (entry->state == "RESOLVED")
+                    resolved.emplace_back(entry.get(), part);
+            }
+        }
+    }
+    std::sort(resolved.begin(), resolved.end(), [](const auto& a, const auto& b) {
+        return a.first->time < b.first->time;
+    });
+
+    // newest alerts are kept up to the limits
+    uint64_t                                                 now  = uint64_t(zclock_time() / 1000);
+    size_t                                                   kept = 0;
+    ElementCounts                                            keptByElement;
+    std::vector<std::pair<const SnapshotEntry*, Partition*>> purged;
+    for (auto it = resolved.rbegin(); it != resolved.rend(); ++it) {
+        const SnapshotEntry& entry     = *it->first;
+        size_t&              ofElement = s_element_count(keptByElement, entry.name.c_str());
+        if ((!retention.age || entry.time + retention.age >= now)
+            && (!retention.history || entry.time + retention.history >= now)
+            && (!retention.count || kept < retention.count)
+            && (!retention.element || ofElement < retention.element)) {
+            kept++;
+            ofElement++;
+            continue;
+        }
+        purged.push_back(*it);
+    }
+    if (purged.empty())
+        return;
+
+    if (retention.history) {
+        zlistx_t* alerts = zlistx_new();
+        zlistx_set_destructor(alerts, reinterpret_cast<czmq_destructor*>(fty_proto_destroy));
+        for (const auto& it : purged) {
+            fty_proto_t* alert = s_snapshot_alert(*it.first);
+            if (alert)
+                zlistx_add_end(alerts, alert);
+        }
+        int rv = alert_history_append(s_history_path().c_str(), alerts);
+        zlistx_destroy(&alerts);
+        if (rv != 0) {
+            log_error("retention: history not written, %zu resolved alerts kept", purged.size());
+            return;
+        }
+    }
+
+    std::vector<zmsg_t*> batches(inboxes.size(), nullptr);
+    for (const auto& it : purged) {
+        zmsg_t*& batch = batches[it.second->id];
+        if (!batch) {
+            batch = zmsg_new();
+            zmsg_addstr(batch, "PURGE");
+        }
+        zmsg_addstr(batch, it.first->rule.c_str());
+        zmsg_addstr(batch, it.first->name.c_str());
+        zmsg_addstrf(batch, "%" PRIu64, it.first->time);
+        if (zmsg_size(batch) > 3 * RETENTION_BATCH && zmsg_send(&batch, inboxes[it.second->id]) != 0)
+            zmsg_destroy(&batch);
+    }
+    for (size_t i = 0; i < batches.size(); i++) {
+        if (batches[i] && zmsg_send(&batches[i], inboxes[i]) != 0)
+            zmsg_destroy(&batches[i]);
+    }
+    log_info("retention: %s %zu of %zu resolved alerts", retention.history ? "moving to the history" : "purging",
+        purged.size(), resolved.size());
+}
+
+// ask the checkpoint actor (owning the activity log) to drop the activity periods ended
+// before the longest retention age, if any
+// EXPIRE/before
+static void s_activity_expire(zsock_t* journal, const Retention& retention)
+{
+    uint64_t age = std::max(retention.age, retention.history);
+    uint64_t now = uint64_t(zclock_time() / 1000);
+    if (!age || age >= now || !journaling)
+        return;
+
+    zmsg_t* msg = zmsg_new();
+    zmsg_addstr(msg, "EXPIRE");
+    zmsg_addstrf(msg, "%" PRIu64, now - age);
+    if (zmsg_send(&msg, journal) != 0)
+        zmsg_destroy(&msg);
+}
+
+// retention worker: sweeps the store every RETENTION_PERIOD ms, off the thread receiving
+// the deliveries (sorting the RESOLVED alerts and writing the history take a while)
+static void s_retention_worker(zsock_t* pipe, void* /* args */)
+{
+    std::vector<zsock_t*> inboxes;
+    for (Partition* part : partitions)
+        inboxes.push_back(zsock_new_push((">" + part->inbox).c_str()));
+    zsock_t* journal = zsock_new_push((">" + journalEndpoint).c_str());
+
+    Retention retention;
+    int64_t   nextSweep = 0;
+
+    zpoller_t* poller = zpoller_new(pipe, nullptr);
+    zsock_signal(pipe, 0);
+
+    while (!zsys_interrupted) {
+
+        void* which = zpoller_wait(poller, 1000);
+
+        if (which == pipe) {
+            zmsg_t* msg = zmsg_recv(pipe);
+            char*   cmd = zmsg_popstr(msg);
+            if (!cmd || streq(cmd, "$TERM")) {
+                zstr_free(&cmd);
+                zmsg_destroy(&msg);
+                break;
+            } else if (streq(cmd, "RETENTION")) {
+                // RETENTION/age/count/element - RESOLVED alerts are kept 'age' s, up to 'count'
+                // of them and 'element' of them per element (0 - unlimited)
+                char* age     = zmsg_popstr(msg);
+                char* count   = zmsg_popstr(msg);
+                char* element = zmsg_popstr(msg);
+                if (age && count && element) {
+                    retention.age     = strtoull(age, nullptr, 10);
+                    retention.count   = strtoull(count, nullptr, 10);
+                    retention.element = strtoull(element, nullptr, 10);
+                    nextSweep         = 0;
+                    log_debug("resolved alerts kept %s s, %s of them, %s per element", age, count, element);
+                } else {
+                    log_error("RETENTION: missing age, count or element");
+                }
+                zstr_free(&age);
+                zstr_free(&count);
+                zstr_free(&element);
+            } else if (streq(cmd, "HISTORY")) {
+                // HISTORY/age - RESOLVED alerts move to the history 'age' s after their resolution,
+                // those purged by the retention policy as well (0 - no history)
+                char* age = zmsg_popstr(msg);
+                if (age) {
+                    retention.history = strtoull(age, nullptr, 10);
+                    nextSweep         = 0;
+                    log_debug("resolved alerts move to the history after %s s", age);
+                } else {
+                    log_error("HISTORY: missing age");
+                }
+                zstr_free(&age);
+            }
+            zstr_free(&cmd);
+            zmsg_destroy(&msg);
+        }
+
+        if (zclock_mono() >= nextSweep) {
+            s_retention_sweep(inboxes, retention);
+            s_activity_expire(journal, retention);
+            nextSweep = zclock_mono() + RETENTION_PERIOD;
+        }
+    }
+
+    zpoller_destroy(&poller);
+    zsock_destroy(&journal);
+    for (zsock_t*& inbox : inboxes)
+        zsock_destroy(&inbox);
+}
+
+// stream actor: receives deliveries from malamute and dispatches them to the stream
+// workers by alert key, one per partition of the store, so that deliveries of distinct
+// alerts are applied in parallel while those of one alert stay in order
 void fty_alert_list_server_stream(zsock_t* pipe, void* args)
 {
     log_info("Started");
+    assert(!partitions.empty());
 
     const char* endpoint = reinterpret_cast<const char*>(args);
     log_debug("Stream endpoint = %s", endpoint);
 
-    zhash_t*      expirations = zhash_new();
-    mlm_client_t* client      = mlm_client_new();
+    std::vector<zactor_t*> workers;
+    std::vector<zsock_t*>  inboxes;
+    for (Partition* part : partitions) {
+        WorkerArgs wargs = {endpoint, part};
+        workers.push_back(zactor_new(s_stream_worker, &wargs));
+        inboxes.push_back(zsock_new_push((">" + part->inbox).c_str()));
+    }
+    log_debug("%zu stream workers started", workers.size());
+
+    mlm_client_t* client = mlm_client_new();
     mlm_client_connect(client, endpoint, 1000, "fty-alert-list-stream");
     mlm_client_set_consumer(client, "_ALERTS_SYS", ".*");
-    mlm_client_set_producer(client, "ALERTS");
+
+    // RESOLVED alerts are purged in the background, as the retention policy requires
+    zactor_t* retention = zactor_new(s_retention_worker, nullptr);
 
     zpoller_t* poller = zpoller_new(pipe, mlm_client_msgpipe(client), nullptr);
     zsock_signal(pipe, 0);
@@ -562,12 +2591,22 @@ void fty_alert_list_server_stream(zsock_t* pipe, void* args)
         if (which == pipe) {
             zmsg_t* msg = zmsg_recv(pipe);
             char*   cmd = zmsg_popstr(msg);
-            if (streq(cmd, "$TERM")) {
+            if (!cmd || streq(cmd, "$TERM")) {
                 zstr_free(&cmd);
                 zmsg_destroy(&msg);
                 break;
-            } else if (streq(cmd, "TTLCLEANUP")) {
-                s_resolve_expired_alerts(expirations);
+            } else if (streq(cmd, "RETENTION") || streq(cmd, "HISTORY")) {
+                // retention policy, applied by the retention worker
+                zmsg_pushstr(msg, cmd);
+                if (zmsg_send(&msg, retention) != 0)
+                    zmsg_destroy(&msg);
+            } else {
+                // configuration applies to all workers
+                for (zsock_t* inbox : inboxes) {
+                    zmsg_t* copy = zmsg_dup(msg);
+                    zmsg_pushstr(copy, cmd);
+                    zmsg_send(&copy, inbox);
+                }
             }
             zstr_free(&cmd);
             zmsg_destroy(&msg);
@@ -576,7 +2615,9 @@ void fty_alert_list_server_stream(zsock_t* pipe, void* args)
             if (!msg) {
                 break;
             } else if (streq(mlm_client_command(client), "STREAM DELIVER")) {
-                s_handle_stream_deliver(client, &msg, expirations);
+                fty_proto_t* alert = s_stream_decode(&msg);
+                if (alert)
+                    s_stream_dispatch(inboxes, mlm_client_subject(client), alert);
             } else {
                 log_warning("Unknown command '%s'. Subject: '%s', Sender: '%s'.", mlm_client_command(client),
                     mlm_client_subject(client), mlm_client_sender(client));
@@ -587,7 +2628,11 @@ void fty_alert_list_server_stream(zsock_t* pipe, void* args)
 
     mlm_client_destroy(&client);
     zpoller_destroy(&poller);
-    zhash_destroy(&expirations);
+    zactor_destroy(&retention);
+    for (zactor_t*& worker : workers)
+        zactor_destroy(&worker);
+    for (zsock_t*& inbox : inboxes)
+        zsock_destroy(&inbox);
 
     log_info("Ended");
 }
@@ -597,16 +2642,39 @@ void fty_alert_list_server_mailbox(zsock_t* pipe, void* args)
     const char* endpoint = reinterpret_cast<const char*>(args);
     log_debug("Mailbox endpoint = %s", endpoint);
 
+    // acknowledged alerts are published by the stream workers owning them
     mlm_client_t* client = mlm_client_new();
     mlm_client_connect(client, endpoint, 1000, "fty-alert-list");
-    mlm_client_set_producer(client, "ALERTS");
 
+    MailboxContext ctx;
+    for (Partition* part : partitions)
+        ctx.inboxes.push_back(zsock_new_push((">" + part->inbox).c_str()));
+    ctx.replies     = zsock_new_pull(("@" + repliesEndpoint).c_str());
+    ctx.replyPoller = zpoller_new(ctx.replies, nullptr);
+    ctx.ackLog      = alert_ack_log_open(statePath.c_str(), stateFile.c_str());
+
+    // requests are read while the state file loads, those about alerts not restored yet wait
+    // for them in ctx.deferred
     zpoller_t* poller = zpoller_new(pipe, mlm_client_msgpipe(client), nullptr);
     zsock_signal(pipe, 0);
 
+    // metrics are published every 'metricsInterval' ms (0 - never)
+    int64_t metricsInterval = 0;
+    int64_t nextMetrics     = 0;
+    bool    producer        = false;
+
     while (!zsys_interrupted) {
 
-        void* which = zpoller_wait(poller, 1000);
+        if (!ctx.deferred.empty())
+            s_serve_deferred(client, ctx);
+
+        void* which = zpoller_wait(poller, ctx.deferred.empty() ? 1000 : 100);
+
+        if (metricsInterval && zclock_mono() >= nextMetrics) {
+            s_publish_metrics(client, uint32_t(2 * metricsInterval / 1000));
+            nextMetrics = zclock_mono() + metricsInterval;
+        }
+
         if (which == pipe) {
             zmsg_t* msg = zmsg_recv(pipe);
             char*   cmd = zmsg_popstr(msg);
@@ -614,52 +2682,466 @@ void fty_alert_list_server_mailbox(zsock_t* pipe, void* args)
                 zstr_free(&cmd);
                 zmsg_destroy(&msg);
                 break;
+            } else if (streq(cmd, "METRICS")) {
+                // METRICS/interval - metrics published on METRICS every 'interval' s (0 - never)
+                char* interval = zmsg_popstr(msg);
+                if (interval) {
+                    metricsInterval = std::max<int64_t>(atoll(interval), 0) * 1000;
+                    nextMetrics     = zclock_mono() + metricsInterval;
+                    if (metricsInterval && !producer) {
+                        mlm_client_set_producer(client, "METRICS");
+                        producer = true;
+                    }
+                    log_debug("metrics published every %s s", interval);
+                } else {
+                    log_error("METRICS: missing interval");
+                }
+                zstr_free(&interval);
             }
             zstr_free(&cmd);
             zmsg_destroy(&msg);
         } else if (which == mlm_client_msgpipe(client)) {
-            zmsg_t* msg = mlm_client_recv(client);
-            if (!msg) {
+            // acknowledgements received together are committed together (one sync of the log)
+            bool closed = false;
+            do {
+                zmsg_t* msg = mlm_client_recv(client);
+                if (!msg) {
+                    closed = true;
+                    break;
+                } else if (streq(mlm_client_command(client), "MAILBOX DELIVER")) {
+                    s_handle_mailbox_request(client, ctx, &msg);
+                } else {
+                    log_warning("Unknown command '%s'. Subject: '%s', Sender: '%s'.", mlm_client_command(client),
+                        mlm_client_subject(client), mlm_client_sender(client));
+                    zmsg_destroy(&msg);
+                }
+            } while (ctx.acks.size() < ACK_BATCH && (zsock_events(mlm_client_msgpipe(client)) & ZMQ_POLLIN));
+            s_ack_commit(client, ctx);
+            if (closed)
                 break;
-            } else if (streq(mlm_client_command(client), "MAILBOX DELIVER")) {
-                s_handle_mailbox_deliver(client, &msg);
-            } else {
-                log_warning("Unknown command '%s'. Subject: '%s', Sender: '%s'.", mlm_client_command(client),
-                    mlm_client_subject(client), mlm_client_sender(client));
-                zmsg_destroy(&msg);
-            }
         }
     }
 
+    for (DeferredRequest& request : ctx.deferred)
+        zmsg_destroy(&request.msg);
+    if (ctx.ackLog != -1)
+        close(ctx.ackLog);
     mlm_client_destroy(&client);
     zpoller_destroy(&poller);
+    zpoller_destroy(&ctx.replyPoller);
+    zsock_destroy(&ctx.replies);
+    for (zsock_t*& inbox : ctx.inboxes)
+        zsock_destroy(&inbox);
+}
+
+// save the state file from the published snapshots
+// (the snapshots of all partitions are taken first, then serialized one alert at a time
+// from private copies, so the workers go on meanwhile and stored alerts are never read)
+// 'handoff' - copy the saved state to shared memory for the next process as well
+// 0 - success, -1 - error
+static int s_save_alerts(bool handoff = false)
+{
+    if (loading != 0) {
+        log_warning("state not loaded completely yet, not saved");
+        return -1;
+    }
+
+    std::vector<std::shared_ptr<const Snapshot>> published;
+    for (Partition* part : partitions)
+        published.push_back(s_snapshot(*part));
+
+    AlertState state;
+    for (const auto& snapshot : published) {
+        if (!snapshot)
+            continue;
+        for (const auto& chunk : snapshot->chunks) {
+            for (const auto& entry : *chunk) {
+                fty_proto_t* alert = s_snapshot_alert(*entry);
+                if (!alert)
+                    continue;
+                alert_state_add(state, alert);
+                fty_proto_destroy(&alert);
+            }
+        }
+    }
+
+    int rv = alert_state_save(state, statePath.c_str(), stateFile.c_str());
+    log_debug("alert_state_save () == %d (%" PRIu32 " alerts)", rv, state.count);
+
+    // written after the state file, so that a handoff older than it is recognized
+    if (rv == 0 && handoff) {
+        std::string name = std::string(HANDOFF_PREFIX) + stateFile;
+        if (alert_state_save(state, HANDOFF_PATH, name.c_str(), 0600) == 0)
+            log_info("state handed off in %s/%s", HANDOFF_PATH, name.c_str());
+    }
+    return rv;
 }
 
 void save_alerts()
 {
-    int rv = alert_save_state(alerts, STATE_PATH, STATE_FILE, verbose);
-    log_debug("alert_save_state () == %d", rv);
+    s_save_alerts();
+}
+
+// save the state file by a checkpoint, the acknowledgements applied until then are in it
+// (they are applied once logged, and confirmed once the worker published them)
+static int s_save_checkpoint(bool handoff)
+{
+    uint64_t acks = acksApplied.load();
+    int      rv   = s_save_alerts(handoff);
+    if (rv == 0)
+        acksSaved = acks;
+    return rv;
+}
+
+// state owned by the checkpoint actor
+struct CheckpointContext
+{
+    int64_t  interval  = CHECKPOINT_INTERVAL * 1000; // ms, 0 - no periodic checkpoint
+    uint64_t threshold = CHECKPOINT_CHANGES;          // 0 - no checkpoint on change count
+    uint64_t saved     = 0;                           // changes at the last checkpoint
+    int64_t  last      = 0;                           // last checkpoint (monotonic clock, ms)
+
+    zsock_t* journal    = nullptr; // records pushed by the stream workers
+    int      fd         = -1;      // current journal generation
+    uint64_t generation = 0;
+
+    uint64_t merge     = CHECKPOINT_MERGE; // %, 0 - state file rewritten by each checkpoint
+    uint64_t journaled = 0;                // bytes journaled since the state file was saved
+    uint64_t stateSize = 0;                // of the state file when it was saved
+
+    AlertActivityLog activity; // ended activity periods, also pushed by the stream workers
+
+    bool handoff = false; // hand the state off to the next process on stop
+};
+
+// activity periods of an ACTIVITY message (see s_activity_record()) added to 'periods'
+static void s_activity_periods(zmsg_t* msg, std::vector<AlertActivity>& periods)
+{
+    while (zmsg_size(msg) >= 5) {
+        AlertActivity period;
+        char*         start    = zmsg_popstr(msg);
+        char*         end      = zmsg_popstr(msg);
+        char*         rule     = zmsg_popstr(msg);
+        char*         element  = zmsg_popstr(msg);
+        char*         severity = zmsg_popstr(msg);
+        period.start           = strtoull(start, nullptr, 10);
+        period.end             = strtoull(end, nullptr, 10);
+        period.rule            = rule;
+        period.element         = element;
+        period.severity        = severity;
+        periods.push_back(std::move(period));
+        zstr_free(&start);
+        zstr_free(&end);
+        zstr_free(&rule);
+        zstr_free(&element);
+        zstr_free(&severity);
+    }
+}
+
+// write received journal records, synced once for the whole batch (group commit),
+// and the activity periods received with them; expire the activity log if asked to
+// (see s_activity_expire())
+static void s_journal_commit(CheckpointContext& ctx)
+{
+    std::string                batch;
+    std::vector<AlertActivity> periods;
+    uint64_t                   expire = 0;
+    int                        count  = 0;
+    while (count < JOURNAL_BATCH && (zsock_events(ctx.journal) & ZMQ_POLLIN)) {
+        zmsg_t*   msg   = zmsg_recv(ctx.journal);
+        zframe_t* op    = zmsg_first(msg);
+        zframe_t* alert = zmsg_next(msg);
+        if (op && zframe_streq(op, "ACTIVITY")) {
+            zframe_t* command = zmsg_pop(msg);
+            zframe_destroy(&command);
+            s_activity_periods(msg, periods);
+        } else if (op && alert && zframe_streq(op, "EXPIRE")) {
+            char* before = zframe_strdup(alert);
+            expire       = std::max(expire, uint64_t(strtoull(before, nullptr, 10)));
+            zstr_free(&before);
+        } else if (op && alert && zframe_size(op) == 1) {
+            alert_journal_record(batch, *zframe_data(op), zframe_data(alert), zframe_size(alert));
+        }
+        zmsg_destroy(&msg);
+        count++;
+    }
+    if (!periods.empty() && ctx.activity.fd != -1 && alert_activity_append(ctx.activity, periods) != 0)
+        log_error("%zu activity periods not persisted", periods.size());
+    if (expire && ctx.activity.fd != -1)
+        alert_activity_expire(ctx.activity, statePath.c_str(), stateFile.c_str(), expire);
+    if (batch.empty() || ctx.fd == -1)
+        return;
+    if (alert_journal_write(ctx.fd, batch) != 0)
+        log_error("%d journal records not persisted", count);
+    else
+        ctx.journaled += batch.size();
+}
+
+// size of the saved state file, 0 if there is none
+static uint64_t s_state_size()
+{
+    struct stat st;
+    std::string file = statePath + "/" + stateFile;
+    return stat(file.c_str(), &st) == 0 ? uint64_t(st.st_size) : 0;
 }
 
-void init_alert_private(const char* path, const char* filename, bool verb)
+// save the state file, compacting the journal into it
+//
+// workers publish a snapshot before journaling the changes it holds, so records written
+// before the journal is rotated are all in the snapshots saved after; later records go
+// to the new generation (replaying a change already saved is harmless)
+static void s_checkpoint(CheckpointContext& ctx, bool last)
 {
-    alerts = zlistx_new();
-    assert(alerts);
-    zlistx_set_destructor(alerts, reinterpret_cast<czmq_destructor*>(fty_proto_destroy));
-    zlistx_set_duplicator(alerts, reinterpret_cast<czmq_duplicator*>(fty_proto_dup));
+    uint64_t current = changes.load();
 
-    int rv = alert_load_state(alerts, path, filename);
-    log_debug("alert_load_state () == %d", rv);
+    if (ctx.fd != -1) {
+        close(ctx.fd);
+        ctx.fd = -1;
+    }
+    if (!last) {
+        ctx.generation++;
+        ctx.fd = alert_journal_open(statePath.c_str(), stateFile.c_str(), ctx.generation);
+    }
+
+    if (s_save_checkpoint(last && ctx.handoff) == 0) {
+        alert_journal_remove(statePath.c_str(), stateFile.c_str(), last ? UINT64_MAX : ctx.generation);
+        // the mailbox stopped before: no acknowledgement comes anymore
+        if (last)
+            alert_ack_log_remove(statePath.c_str(), stateFile.c_str());
+        ctx.journaled = 0;
+        ctx.stateSize = s_state_size();
+    }
+    ctx.saved = current;
+    ctx.last  = zclock_mono();
+}
+
+// checkpoint at the change rate: changes since the last one are in the journal already
+// (synced), the state file is rewritten only once the journal grew big compared to it
+static void s_checkpoint_incremental(CheckpointContext& ctx)
+{
+    if (ctx.fd == -1 || ctx.journaled * 100 >= ctx.merge * ctx.stateSize) {
+        log_debug("checkpoint: merging %" PRIu64 " journaled bytes into the state file", ctx.journaled);
+        s_checkpoint(ctx, false);
+        return;
+    }
+    log_debug("checkpoint: %" PRIu64 " changes, %" PRIu64 " bytes journaled", changes.load() - ctx.saved,
+        ctx.journaled);
+    ctx.saved = changes.load();
+    ctx.last  = zclock_mono();
+}
+
+// checkpoint actor: journals the mutations of the store and saves the state file from
+// the published snapshots in the background, so that little is lost if the agent does
+// not stop cleanly
+void fty_alert_list_server_checkpoint(zsock_t* pipe, void* /* args */)
+{
+    CheckpointContext ctx;
+    ctx.saved     = changes.load();
+    ctx.last      = zclock_mono();
+    ctx.stateSize = s_state_size();
+
+    ctx.journal = zsock_new_pull(("@" + journalEndpoint).c_str());
+    assert(ctx.journal);
+    std::vector<uint64_t> replayed = alert_journal_generations(statePath.c_str(), stateFile.c_str());
+    ctx.generation                 = replayed.empty() ? 1 : replayed.back() + 1;
+    ctx.fd                         = alert_journal_open(statePath.c_str(), stateFile.c_str(), ctx.generation);
+    journaling                     = ctx.fd != -1;
+    alert_activity_open(ctx.activity, statePath.c_str(), stateFile.c_str());
+
+    // journal and acknowledgement log replayed at startup are compacted as soon as the state is loaded
+    bool loaded = false;
+
+    // runs until $TERM even when interrupted: the final checkpoint follows the end of the stream
+    zpoller_t* poller = zpoller_new(pipe, ctx.journal, nullptr);
+    zpoller_set_nonstop(poller, true);
+    zsock_signal(pipe, 0);
+
+    while (true) {
+
+        void* which = zpoller_wait(poller, 1000);
+        if (which == pipe) {
+            zmsg_t* msg = zmsg_recv(pipe);
+            char*   cmd = zmsg_popstr(msg);
+            if (!cmd || streq(cmd, "$TERM")) {
+                zstr_free(&cmd);
+                zmsg_destroy(&msg);
+                break;
+            } else if (streq(cmd, "CHECKPOINT")) {
+                // CHECKPOINT/interval/changes[/handoff] - interval (s) and change count triggering
+                // a checkpoint, handoff of the state in shared memory on stop (0/1, default 0)
+                char* period  = zmsg_popstr(msg);
+                char* count   = zmsg_popstr(msg);
+                char* handoff = zmsg_popstr(msg);
+                if (period && count) {
+                    ctx.interval  = atoll(period) * 1000;
+                    ctx.threshold = strtoull(count, nullptr, 10);
+                    ctx.handoff   = handoff && atoi(handoff) != 0;
+                    log_debug("checkpoint every %s s or %s changes%s", period, count, ctx.handoff ? ", handoff" : "");
+                } else {
+                    log_error("CHECKPOINT: missing interval or changes");
+                }
+                zstr_free(&period);
+                zstr_free(&count);
+                zstr_free(&handoff);
+            } else if (streq(cmd, "MERGE")) {
+                // MERGE/percent - journal size, relative to the state file, merged into it by a checkpoint
+                char* percent = zmsg_popstr(msg);
+                if (percent) {
+                    ctx.merge = strtoull(percent, nullptr, 10);
+                    log_debug("journal merged into the state file at %s %%", percent);
+                } else {
+                    log_error("MERGE: missing percent");
+                }
+                zstr_free(&percent);
+            }
+            zstr_free(&cmd);
+            zmsg_destroy(&msg);
+        } else if (which == ctx.journal) {
+            s_journal_commit(ctx);
+        }
+
+        // no checkpoint of an incomplete store
+        if (!loaded) {
+            loaded = loading == 0;
+            if (!loaded)
+                continue;
+            ctx.saved = changes.load();
+            if ((!replayed.empty() || acksSaved != acksLogged) && s_save_checkpoint(false) == 0) {
+                alert_journal_remove(statePath.c_str(), stateFile.c_str(), ctx.generation);
+                ctx.stateSize = s_state_size();
+            }
+        }
+
+        uint64_t current = changes.load();
+        int64_t  now     = zclock_mono();
+        if (current != ctx.saved
+            && ((ctx.threshold && current - ctx.saved >= ctx.threshold)
+                || (ctx.interval && now - ctx.last >= ctx.interval))) {
+            s_checkpoint_incremental(ctx);
+        }
+    }
+
+    // final checkpoint leaves no journal behind
+    // (unless the state never loaded completely: nothing is saved, the journal stays)
+    journaling = false;
+    while (zsock_events(ctx.journal) & ZMQ_POLLIN)
+        s_journal_commit(ctx);
+    s_checkpoint(ctx, true);
+    alert_activity_close(ctx.activity);
+
+    zpoller_destroy(&poller);
+    zsock_destroy(&ctx.journal);
+}
+
+// load the state file and its journal (or the state handed off by the previous process,
+// if configured), then hand each partition its alerts
+static void s_load_state(std::string path, std::string filename, uint64_t last, bool handoff)
+{
+    zlistx_t* loaded = zlistx_new();
+    assert(loaded);
+    zlistx_set_destructor(loaded, reinterpret_cast<czmq_destructor*>(fty_proto_destroy));
+    zlistx_set_duplicator(loaded, reinterpret_cast<czmq_duplicator*>(fty_proto_dup));
+
+    int64_t     start   = zclock_mono();
+    // a handoff is usable instead of the state file if no journal was written since
+    std::string shared = std::string(HANDOFF_PREFIX) + filename;
+    if (handoff && last != 0)
+        log_info("ignoring stale state handoff %s/%s", HANDOFF_PATH, shared.c_str());
+    if (handoff && last == 0
+        && alert_load_handoff(loaded, HANDOFF_PATH, shared.c_str(), path.c_str(), filename.c_str()) == 0) {
+        log_info("state handed off by the previous process in %s/%s", HANDOFF_PATH, shared.c_str());
+    } else {
+        zlistx_purge(loaded);
+        int rv = alert_load_state(loaded, path.c_str(), filename.c_str());
+        log_debug("alert_load_state () == %d", rv);
+        rv = last ? alert_journal_replay(loaded, path.c_str(), filename.c_str(), last) : 0;
+        log_debug("alert_journal_replay () == %d", rv);
+    }
+    // acknowledgements confirmed after the last save, the journal may have lost them
+    int acks = alert_ack_log_replay(loaded, path.c_str(), filename.c_str());
+    log_debug("alert_ack_log_replay () == %d", acks);
+    // a handoff is used once
+    if (handoff)
+        unlink((std::string(HANDOFF_PATH) + "/" + shared).c_str());
+    log_info("%zu alerts loaded in %" PRIi64 " ms", zlistx_size(loaded), zclock_mono() - start);
+
+    std::vector<zlistx_t*> restored;
+    for (size_t i = 0; i < partitions.size(); i++) {
+        restored.push_back(zlistx_new());
+        zlistx_set_destructor(restored.back(), reinterpret_cast<czmq_destructor*>(fty_proto_destroy));
+    }
+    while (zlistx_size(loaded) > 0) {
+        fty_proto_t* alert = reinterpret_cast<fty_proto_t*>(zlistx_detach(loaded, nullptr));
+        zlistx_add_end(restored[s_partition(fty_proto_rule(alert), fty_proto_name(alert)).id], alert);
+    }
+    zlistx_destroy(&loaded);
+
+    // workers take their part over from their loop, the message only wakes them up
+    for (Partition* part : partitions) {
+        part->restored = restored[part->id];
+        zsock_t* inbox = zsock_new_push((">" + part->inbox).c_str());
+        if (inbox)
+            zstr_send(inbox, "RESTORED");
+        zsock_destroy(&inbox);
+    }
+}
+
+void init_alert_private(const char* path, const char* filename, bool verb, size_t workers, bool handoff)
+{
+    static int generation = 0; // inbox endpoints stay unique across re-initializations
+    generation++;
+    if (loader.joinable())
+        loader.join();
+    repliesEndpoint = "inproc://fty-alert-list-replies-" + std::to_string(generation);
+    journalEndpoint = "inproc://fty-alert-list-journal-" + std::to_string(generation);
+
+    statePath = path;
+    stateFile = filename;
+
+    if (workers == 0)
+        workers = std::max(1u, std::min(unsigned(MAX_PARTITIONS), std::thread::hardware_concurrency()));
+
+    for (size_t i = 0; i < workers; i++) {
+        Partition* part = new Partition;
+        part->id        = i;
+        part->inbox     = "inproc://fty-alert-list-partition-" + std::to_string(generation) + "-" + std::to_string(i);
+        part->alerts    = zlistx_new();
+        assert(part->alerts);
+        zlistx_set_destructor(part->alerts, reinterpret_cast<czmq_destructor*>(fty_proto_destroy));
+        zlistx_set_duplicator(part->alerts, reinterpret_cast<czmq_duplicator*>(fty_proto_dup));
+        partitions.push_back(part);
+    }
+
+    // the state is loaded in the background, the journal as it is now: generations started
+    // afterwards hold changes made since
+    std::vector<uint64_t> generations = alert_journal_generations(path, filename);
+    uint64_t              last        = generations.empty() ? 0 : generations.back();
+    loading                           = partitions.size();
+
+    // acknowledgements logged by the previous process stay until the next save
+    struct stat acks;
+    acksSaved   = 0;
+    acksLogged  = stat((std::string(path) + "/" + filename + ".acks").c_str(), &acks) == 0 && acks.st_size > 0;
+    acksApplied = acksLogged.load(); // by the replay
+    loader      = std::thread(s_load_state, std::string(path), std::string(filename), last, handoff);
 
     verbose = verb;
 }
 
-void init_alert(bool verb)
+void init_alert(bool verb, size_t workers, bool handoff)
 {
-    init_alert_private(STATE_PATH, STATE_FILE, verb);
+    init_alert_private(STATE_PATH, STATE_FILE, verb, workers, handoff);
 }
 
 void destroy_alert()
 {
-    zlistx_destroy(&alerts);
+    if (loader.joinable())
+        loader.join();
+    for (Partition* part : partitions) {
+        zlistx_t* restored = part->restored.exchange(nullptr);
+        zlistx_destroy(&restored);
+        zlistx_destroy(&part->alerts);
+        delete part;
+    }
+    partitions.clear();
 }
@@ -24,8 +24,13 @@
 
 ///  zactor ready fnction
 void fty_alert_list_server_stream(zsock_t* pipe, void* args);
-void init_alert(bool verb);
+// 'workers' - number of stream workers (partitions of the store), 0 - chosen from the number of CPUs
+// the state file is loaded in the background, stream workers restore their partition from it
+// 'handoff' - the state handed off by the previous process is loaded instead if usable (see
+// checkpoint/handoff)
+void init_alert(bool verb, size_t workers = 0, bool handoff = false);
 void destroy_alert();
 void save_alerts();
 void fty_alert_list_server_mailbox(zsock_t* pipe, void* args);
-void init_alert_private(const char* path, const char* filename, bool verb);
+void fty_alert_list_server_checkpoint(zsock_t* pipe, void* args);
+void init_alert_private(const char* path, const char* filename, bool verb, size_t workers = 0, bool handoff = false);
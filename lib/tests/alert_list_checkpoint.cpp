@@ -0,0 +1,145 @@
+#include <catch2/catch.hpp>
+#include "src/fty_alert_list_server.h"
+#include "src/alerts_journal.h"
+#include "src/alerts_utils.h"
+#include <fty_proto.h>
+#include <malamute.h>
+#include <sys/stat.h>
+#include <vector>
+
+#define SELFTEST_STATE "./test_alert_list_checkpoint"
+
+// remove directory 'path' and its content
+static void test_remove_dir(const char* path)
+{
+    zdir_t* dir = zdir_new(path, "-");
+    if (dir) {
+        zdir_remove(dir, true);
+        zdir_destroy(&dir);
+    }
+}
+
+// wait (at most 'timeout' ms) until the journal generations on disk are 'expected'
+static bool test_wait_generations(const std::vector<uint64_t>& expected, int64_t timeout = 5000)
+{
+    int64_t deadline = zclock_mono() + timeout;
+    while (alert_journal_generations(SELFTEST_STATE, "state_file") != expected) {
+        if (zclock_mono() > deadline)
+            return false;
+        zclock_sleep(50);
+    }
+    return true;
+}
+
+static int64_t test_state_size()
+{
+    struct stat st;
+    return stat(SELFTEST_STATE "/state_file", &st) == 0 ? int64_t(st.st_size) : -1;
+}
+
+// publish alert ('rule', 'element') and wait for its publication on ALERTS
+static void test_publish(mlm_client_t* producer, mlm_client_t* consumer, const char* rule, const char* severity)
+{
+    zlist_t* actions = zlist_new();
+    zlist_autofree(actions);
+    zlist_append(actions, const_cast<char*>("EMAIL"));
+    zmsg_t* msg = fty_proto_encode_alert(nullptr, uint64_t(zclock_time() / 1000), 0, rule, "checkpoint-ups", "ACTIVE",
+        severity, "description", actions);
+    zlist_destroy(&actions);
+    REQUIRE(mlm_client_send(producer, rule, &msg) == 0);
+    while (true) {
+        zmsg_t* published = mlm_client_recv(consumer);
+        REQUIRE(published);
+        fty_proto_t* decoded = fty_proto_decode(&published);
+        REQUIRE(decoded);
+        bool found = streq(fty_proto_rule(decoded), rule) && streq(fty_proto_severity(decoded), severity);
+        fty_proto_destroy(&decoded);
+        if (found)
+            return;
+    }
+}
+
+TEST_CASE("alert list checkpoint test")
+{
+    static const char* endpoint = "inproc://fty-lm-checkpoint-test";
+    static const char* rules[]  = {"Checkpoint1", "Checkpoint2", "Checkpoint3", "Checkpoint4", "Checkpoint5"};
+
+    test_remove_dir(SELFTEST_STATE);
+    zsys_dir_create(SELFTEST_STATE);
+
+    zactor_t* server = zactor_new(mlm_server, const_cast<char*>("Malamute"));
+    zstr_sendx(server, "BIND", endpoint, nullptr);
+
+    mlm_client_t* producer = mlm_client_new();
+    REQUIRE(mlm_client_connect(producer, endpoint, 1000, "PRODUCER") == 0);
+    REQUIRE(mlm_client_set_producer(producer, "_ALERTS_SYS") == 0);
+    mlm_client_t* consumer = mlm_client_new();
+    REQUIRE(mlm_client_connect(consumer, endpoint, 1000, "CONSUMER") == 0);
+    REQUIRE(mlm_client_set_consumer(consumer, "ALERTS", ".*") == 0);
+
+    // the checkpoint actor starts first, so that the workers journal their changes
+    init_alert_private(SELFTEST_STATE, "state_file", false, 2);
+    zactor_t* checkpoint = zactor_new(fty_alert_list_server_checkpoint, nullptr);
+    zactor_t* stream     = zactor_new(fty_alert_list_server_stream, const_cast<char*>(endpoint));
+
+    // change count trigger: 5 changes, no periodic checkpoint; the first checkpoint merges
+    // the journal into the (missing) state file and starts generation 2
+    zstr_sendx(checkpoint, "CHECKPOINT", "0", "5", nullptr);
+    CHECK(test_wait_generations({1}));
+    CHECK(test_state_size() == -1);
+    for (const char* rule : rules)
+        test_publish(producer, consumer, rule, "high");
+    CHECK(test_wait_generations({2}));
+    int64_t saved = test_state_size();
+    CHECK(saved > 0);
+
+    // below the merge threshold, changes stay in the journal and the state file is kept
+    zstr_sendx(checkpoint, "MERGE", "100000", nullptr);
+    for (const char* rule : rules)
+        test_publish(producer, consumer, rule, "low");
+    zclock_sleep(1500);
+    CHECK(alert_journal_generations(SELFTEST_STATE, "state_file") == std::vector<uint64_t>({2}));
+    CHECK(test_state_size() == saved);
+    struct stat journal;
+    REQUIRE(stat(SELFTEST_STATE "/state_file.journal.2", &journal) == 0);
+    CHECK(journal.st_size > 0);
+
+    // once the journal reaches the threshold, it is merged and the older generation removed
+    zstr_sendx(checkpoint, "MERGE", "1", nullptr);
+    for (const char* rule : rules)
+        test_publish(producer, consumer, rule, "high");
+    CHECK(test_wait_generations({3}));
+    CHECK(test_state_size() > 0);
+
+    // interval trigger: without a change count, a single change is saved, at most once a second
+    zstr_sendx(checkpoint, "CHECKPOINT", "1", "0", nullptr);
+    test_publish(producer, consumer, "Checkpoint6", "high");
+    CHECK(test_wait_generations({4}));
+    int64_t saved_at = zclock_mono();
+    test_publish(producer, consumer, "Checkpoint7", "high");
+    CHECK(test_wait_generations({5}));
+    CHECK(zclock_mono() - saved_at >= 800);
+
+    // the final checkpoint leaves no journal behind, the state file holds every alert
+    zactor_destroy(&stream);
+    zactor_destroy(&checkpoint);
+    CHECK(alert_journal_generations(SELFTEST_STATE, "state_file").empty());
+
+    zlistx_t* alerts = zlistx_new();
+    zlistx_set_destructor(alerts, reinterpret_cast<czmq_destructor*>(fty_proto_destroy));
+    zlistx_set_duplicator(alerts, reinterpret_cast<czmq_duplicator*>(fty_proto_dup));
+    CHECK(alert_load_state(alerts, SELFTEST_STATE, "state_file") == 0);
+    CHECK(zlistx_size(alerts) == 7);
+    fty_proto_t* cursor = reinterpret_cast<fty_proto_t*>(zlistx_first(alerts));
+    while (cursor) {
+        CHECK(streq(fty_proto_severity(cursor), "high"));
+        cursor = reinterpret_cast<fty_proto_t*>(zlistx_next(alerts));
+    }
+    zlistx_destroy(&alerts);
+
+    mlm_client_destroy(&consumer);
+    mlm_client_destroy(&producer);
+    zactor_destroy(&server);
+    destroy_alert();
+    test_remove_dir(SELFTEST_STATE);
+}
@@ -1,10 +1,13 @@
 #include <catch2/catch.hpp>
 #include "src/fty_alert_list_server.h"
+#include "src/alerts_history.h"
 #include "src/alerts_utils.h"
 #include <fty_proto.h>
 #include <malamute.h>
 #include <fty_common_utf8.h>
 #include <fty_common_macros.h>
+#include <map>
+#include <string>
 
 #define RFC_ALERTS_LIST_SUBJECT        "rfc-alerts-list"
 #define RFC_ALERTS_ACKNOWLEDGE_SUBJECT "rfc-alerts-acknowledge"
@@ -258,9 +261,67 @@ static void test_alert_publish(mlm_client_t* producer, mlm_client_t* consumer, z
     fty_proto_destroy(message);
 }
 
+// next alert of 'rule' published on ALERTS, skipping any other (e.g. refreshes)
+static fty_proto_t* test_recv_published(mlm_client_t* consumer, const char* rule)
+{
+    while (true) {
+        zmsg_t* zmessage = mlm_client_recv(consumer);
+        REQUIRE(zmessage);
+        fty_proto_t* decoded = fty_proto_decode(&zmessage);
+        REQUIRE(decoded);
+        if (streq(fty_proto_rule(decoded), rule)) {
+            return decoded;
+        }
+        fty_proto_destroy(&decoded);
+    }
+}
+
+// remove directory 'path' and its content
+static void test_remove_dir(const char* path)
+{
+    zdir_t* dir = zdir_new(path, "-");
+    if (dir) {
+        zdir_remove(dir, true);
+        zdir_destroy(&dir);
+    }
+}
+
+// severity of each alert of 'rule' (by element) listed in 'state'
+static std::map<std::string, std::string> test_list_severities(mlm_client_t* ui, const char* state, const char* rule)
+{
+    std::map<std::string, std::string> severities;
+    zmsg_t*                            reply = test_request_alerts_list(ui, state);
+    REQUIRE(reply);
+    char* part = zmsg_popstr(reply);
+    CHECK(streq(part, "LIST"));
+    zstr_free(&part);
+    part = zmsg_popstr(reply);
+    CHECK(streq(part, state));
+    zstr_free(&part);
+
+    zframe_t* frame = zmsg_pop(reply);
+    while (frame) {
+#if CZMQ_VERSION_MAJOR == 3
+        zmsg_t* decoded_zmsg = zmsg_decode(zframe_data(frame), zframe_size(frame));
+#else
+        zmsg_t* decoded_zmsg = zmsg_decode(frame);
+#endif
+        zframe_destroy(&frame);
+        REQUIRE(decoded_zmsg);
+        fty_proto_t* decoded = fty_proto_decode(&decoded_zmsg);
+        REQUIRE(decoded);
+        if (streq(fty_proto_rule(decoded), rule))
+            severities[fty_proto_name(decoded)] = fty_proto_severity(decoded);
+        fty_proto_destroy(&decoded);
+        frame = zmsg_pop(reply);
+    }
+    zmsg_destroy(&reply);
+    return severities;
+}
+
 TEST_CASE("alert list server test")
 {
-    #define SELFTEST_RO "tests/selftest-ro"
+    #define SELFTEST_STATE "./test_alert_list_server"
 
     static const char* endpoint = "inproc://fty-lm-server-test";
 
@@ -287,8 +348,11 @@ TEST_CASE("alert list server test")
     rv = mlm_client_set_consumer(consumer, "ALERTS", ".*");
     REQUIRE(rv == 0);
 
-    // Alert Lists (assume empty)
-    init_alert_private(SELFTEST_RO, "_faked_empty_alerts_", false);
+    // Alert Lists (empty), persisted in a directory of their own
+    // several stream workers, so that alerts are spread over partitions of the store
+    test_remove_dir(SELFTEST_STATE);
+    zsys_dir_create(SELFTEST_STATE);
+    init_alert_private(SELFTEST_STATE, "state_file", false, 4);
     zactor_t* fty_al_server_stream  = zactor_new(fty_alert_list_server_stream, const_cast<char*>(endpoint));
     zactor_t* fty_al_server_mailbox = zactor_new(fty_alert_list_server_mailbox, const_cast<char*>(endpoint));
 
@@ -679,7 +743,11 @@ TEST_CASE("alert list server test")
 
     zclock_sleep(3000);
 
-    // cleanup should resolv alert
+    // stream actor should have resolved the alert on its own by now
+    reply = test_request_alerts_list(ui, "RESOLVED");
+    test_check_result("RESOLVED", testAlerts, &reply, 1);
+
+    // explicit cleanup doesn't change anything
     zstr_send(fty_al_server_stream, "TTLCLEANUP");
     reply = test_request_alerts_list(ui, "RESOLVED");
     test_check_result("RESOLVED", testAlerts, &reply, 1);
@@ -837,6 +905,365 @@ TEST_CASE("alert list server test")
     zstr_free(&part);
     zmsg_destroy(&reply);
 
+    // Flapping alert: toggles within the debounce window are coalesced
+    zstr_sendx(fty_al_server_stream, "FLAPPING", "Flappy", "1000", nullptr);
+    zclock_sleep(100);
+
+    zlist_t* actions13 = zlist_new();
+    zlist_autofree(actions13);
+    zlist_append(actions13, const_cast<char*>("EMAIL"));
+    zmsg_t* flappy = fty_proto_encode_alert(nullptr, 17, 0, "Flappy", "ups", "ACTIVE", "high", "description", actions13);
+    rv             = mlm_client_send(producer, "Flappy", &flappy);
+    REQUIRE(rv == 0);
+    fty_proto_t* decoded = test_recv_published(consumer, "Flappy");
+    CHECK(streq(fty_proto_state(decoded), "ACTIVE"));
+    fty_proto_destroy(&decoded);
+
+    // a single change is not flapping, RESOLVED right after ACTIVE is published...
+    flappy = fty_proto_encode_alert(nullptr, 18, 0, "Flappy", "ups", "RESOLVED", "high", "description", actions13);
+    rv     = mlm_client_send(producer, "Flappy", &flappy);
+    REQUIRE(rv == 0);
+    decoded = test_recv_published(consumer, "Flappy");
+    CHECK(streq(fty_proto_state(decoded), "RESOLVED"));
+    CHECK(streq(fty_proto_aux_string(decoded, "flapping", "0"), "0"));
+    fty_proto_destroy(&decoded);
+
+    // ... ACTIVE again within the window is flapping, it's not published now...
+    int64_t toggled = zclock_mono();
+
+    flappy = fty_proto_encode_alert(nullptr, 19, 0, "Flappy", "ups", "ACTIVE", "high", "description", actions13);
+    rv     = mlm_client_send(producer, "Flappy", &flappy);
+    REQUIRE(rv == 0);
+
+    // ... but once the window elapsed
+    decoded = test_recv_published(consumer, "Flappy");
+    CHECK(zclock_mono() - toggled >= 1000);
+    CHECK(streq(fty_proto_state(decoded), "ACTIVE"));
+    CHECK(streq(fty_proto_aux_string(decoded, "flapping", "0"), "1"));
+    fty_proto_destroy(&decoded);
+
+    // Transitions of the flapping alert, the oldest first
+    send = zmsg_new();
+    zmsg_addstr(send, "TRANSITIONS");
+    zmsg_addstr(send, "1234");
+    zmsg_addstr(send, "flappy");
+    zmsg_addstr(send, "UPS");
+    rv = mlm_client_sendto(ui, "fty-alert-list", "rfc-alerts-transitions", nullptr, 5000, &send);
+    REQUIRE(rv == 0);
+    reply = mlm_client_recv(ui);
+    REQUIRE(reply);
+    CHECK(zmsg_size(reply) == 4 + 3 * 5);
+    for (const char* expected : {"TRANSITIONS", "1234", "flappy", "UPS"}) {
+        part = zmsg_popstr(reply);
+        CHECK(streq(part, expected));
+        zstr_free(&part);
+    }
+    const char* transitions[3][4] = {{"", "ACTIVE", "high", "stream"}, {"ACTIVE", "RESOLVED", "high", "stream"},
+        {"RESOLVED", "ACTIVE", "high", "stream"}};
+    for (const auto& transition : transitions) {
+        part = zmsg_popstr(reply); // time
+        CHECK(strtoull(part, nullptr, 10) > 0);
+        zstr_free(&part);
+        for (const char* expected : transition) {
+            part = zmsg_popstr(reply);
+            CHECK(streq(part, expected));
+            zstr_free(&part);
+        }
+    }
+    zmsg_destroy(&reply);
+
+    send = zmsg_new();
+    zmsg_addstr(send, "TRANSITIONS");
+    zmsg_addstr(send, "1235");
+    zmsg_addstr(send, "Unknown");
+    zmsg_addstr(send, "ups");
+    rv = mlm_client_sendto(ui, "fty-alert-list", "rfc-alerts-transitions", nullptr, 5000, &send);
+    REQUIRE(rv == 0);
+    reply = mlm_client_recv(ui);
+    part  = zmsg_popstr(reply);
+    CHECK(streq(part, "ERROR"));
+    zstr_free(&part);
+    part = zmsg_popstr(reply);
+    CHECK(streq(part, "NOT_FOUND"));
+    zstr_free(&part);
+    zmsg_destroy(&reply);
+
+    // Rate limit of a rule: the end of a flapping period deferred by the token bucket is still
+    // published as such
+    zstr_sendx(fty_al_server_stream, "RATELIMIT", "rule", "0.5", "1", nullptr);
+    zstr_sendx(fty_al_server_stream, "FLAPPING", "FlapLimited", "500", nullptr);
+    zclock_sleep(100);
+
+    zmsg_t* limited = fty_proto_encode_alert(
+        nullptr, 23, 0, "FlapLimited", "ups", "ACTIVE", "high", "description", actions13);
+    rv = mlm_client_send(producer, "FlapLimited", &limited);
+    REQUIRE(rv == 0);
+    decoded = test_recv_published(consumer, "FlapLimited");
+    CHECK(streq(fty_proto_state(decoded), "ACTIVE"));
+    fty_proto_destroy(&decoded);
+    int64_t limitedAt = zclock_mono();
+
+    // no token left: RESOLVED is deferred, then the alert flaps and settles RESOLVED
+    const char* states[] = {"RESOLVED", "ACTIVE", "RESOLVED"};
+    for (const char* state : states) {
+        limited = fty_proto_encode_alert(nullptr, 24, 0, "FlapLimited", "ups", state, "high", "description", actions13);
+        rv      = mlm_client_send(producer, "FlapLimited", &limited);
+        REQUIRE(rv == 0);
+        zclock_sleep(100);
+    }
+    decoded = test_recv_published(consumer, "FlapLimited");
+    CHECK(zclock_mono() - limitedAt >= 1500);
+    CHECK(streq(fty_proto_state(decoded), "RESOLVED"));
+    CHECK(streq(fty_proto_aux_string(decoded, "flapping", "0"), "1"));
+    fty_proto_destroy(&decoded);
+    zstr_sendx(fty_al_server_stream, "RATELIMIT", "rule", "0", "1", nullptr);
+
+    // Global rate limit: publications of all rules are spaced by 1/rate s
+    zstr_sendx(fty_al_server_stream, "RATELIMIT", "global", "5", "1", nullptr);
+    zclock_sleep(100);
+    int64_t pacedAt = zclock_mono();
+    for (const char* rule : {"Paced1", "Paced2", "Paced3", "Paced4"}) {
+        zmsg_t* paced =
+            fty_proto_encode_alert(nullptr, 25, 0, rule, "paced-ups", "ACTIVE", "high", "description", actions13);
+        rv = mlm_client_send(producer, rule, &paced);
+        REQUIRE(rv == 0);
+    }
+    int pacedCount = 0;
+    while (pacedCount < 4) {
+        zmsg_t* zmessage = mlm_client_recv(consumer);
+        REQUIRE(zmessage);
+        decoded = fty_proto_decode(&zmessage);
+        REQUIRE(decoded);
+        if (strncmp(fty_proto_rule(decoded), "Paced", 5) == 0)
+            pacedCount++;
+        fty_proto_destroy(&decoded);
+    }
+    CHECK(zclock_mono() - pacedAt >= 500);
+    zstr_sendx(fty_al_server_stream, "RATELIMIT", "global", "0", "1", nullptr);
+
+    // Activity of an element: the period of its active alert is still going on
+    zmsg_t* active = fty_proto_encode_alert(
+        nullptr, 21, 0, "Active1", "activity-ups", "ACTIVE", "high", "description", actions13);
+    rv = mlm_client_send(producer, "Active1", &active);
+    REQUIRE(rv == 0);
+    decoded = test_recv_published(consumer, "Active1");
+    fty_proto_destroy(&decoded);
+
+    send = zmsg_new();
+    zmsg_addstr(send, "ACTIVITY");
+    zmsg_addstr(send, "1236");
+    zmsg_addstr(send, "0");
+    zmsg_addstr(send, "18446744073709551615");
+    zmsg_addstr(send, "activity-ups");
+    rv = mlm_client_sendto(ui, "fty-alert-list", "rfc-alerts-activity", nullptr, 5000, &send);
+    REQUIRE(rv == 0);
+    reply = mlm_client_recv(ui);
+    REQUIRE(reply);
+    CHECK(zmsg_size(reply) == 3 + 5);
+    for (const char* expected : {"ACTIVITY", "1236", "0", "Active1", "activity-ups", "high"}) {
+        part = zmsg_popstr(reply);
+        CHECK(streq(part, expected));
+        zstr_free(&part);
+    }
+    part = zmsg_popstr(reply); // start
+    CHECK(strtoull(part, nullptr, 10) > 0);
+    zstr_free(&part);
+    part = zmsg_popstr(reply); // no end yet
+    CHECK(streq(part, ""));
+    zstr_free(&part);
+    zmsg_destroy(&reply);
+
+    // History: resolved alerts are sent in messages of at most 100 alerts
+    {
+        zlistx_t* moved = zlistx_new();
+        zlistx_set_destructor(moved, reinterpret_cast<czmq_destructor*>(fty_proto_destroy));
+        zlistx_set_duplicator(moved, reinterpret_cast<czmq_duplicator*>(fty_proto_dup));
+        for (int i = 0; i < 150; i++) {
+            std::string  element = "history-ups-" + std::to_string(i);
+            fty_proto_t* alert =
+                alert_new("History1", element.c_str(), "RESOLVED", "high", "history", uint64_t(100 + i), nullptr, 0);
+            zlistx_add_end(moved, alert);
+            fty_proto_destroy(&alert);
+        }
+        REQUIRE(alert_history_append(SELFTEST_STATE "/history", moved) == 0);
+        zlistx_destroy(&moved);
+    }
+    send = zmsg_new();
+    zmsg_addstr(send, "HISTORY");
+    zmsg_addstr(send, "1238");
+    zmsg_addstr(send, "0");
+    zmsg_addstr(send, "1000");
+    rv = mlm_client_sendto(ui, "fty-alert-list", "rfc-alerts-history", nullptr, 5000, &send);
+    REQUIRE(rv == 0);
+    size_t historyCount = 0;
+    for (const char* more : {"1", "0"}) {
+        reply = mlm_client_recv(ui);
+        REQUIRE(reply);
+        CHECK(streq(mlm_client_subject(ui), "rfc-alerts-history"));
+        for (const char* expected : {"HISTORY", "1238", more}) {
+            part = zmsg_popstr(reply);
+            CHECK(streq(part, expected));
+            zstr_free(&part);
+        }
+        CHECK(zmsg_size(reply) <= 100);
+        historyCount += zmsg_size(reply);
+        zmsg_destroy(&reply);
+    }
+    CHECK(historyCount == 150);
+
+    // Proactive refresh: an ACTIVE alert is republished half way to its TTL, without any
+    // new delivery
+    zmsg_t* refreshed = fty_proto_encode_alert(
+        nullptr, 22, 4, "Refreshed1", "refresh-ups", "ACTIVE", "high", "description", actions13);
+    rv = mlm_client_send(producer, "Refreshed1", &refreshed);
+    REQUIRE(rv == 0);
+    decoded = test_recv_published(consumer, "Refreshed1");
+    fty_proto_destroy(&decoded);
+    int64_t published = zclock_mono();
+
+    decoded = test_recv_published(consumer, "Refreshed1");
+    CHECK(zclock_mono() - published >= 1500);
+    CHECK(streq(fty_proto_state(decoded), "ACTIVE"));
+    CHECK(streq(fty_proto_severity(decoded), "high"));
+    CHECK(fty_proto_ttl(decoded) == 4);
+    fty_proto_destroy(&decoded);
+
+    // TTL expires per (rule, element): of two elements of one rule, only the one not
+    // delivered again is resolved, deliveries of the other one don't keep it
+    for (const char* element : {"expiring-ups-1", "expiring-ups-2"}) {
+        zmsg_t* expiring =
+            fty_proto_encode_alert(nullptr, 23, 2, "Expiring", element, "ACTIVE", "high", "description", actions13);
+        rv = mlm_client_send(producer, "Expiring", &expiring);
+        REQUIRE(rv == 0);
+        decoded = test_recv_published(consumer, "Expiring");
+        fty_proto_destroy(&decoded);
+    }
+    for (int i = 0; i < 8; i++) {
+        zclock_sleep(500);
+        zmsg_t* expiring = fty_proto_encode_alert(
+            nullptr, 23, 2, "Expiring", "expiring-ups-1", "ACTIVE", "high", "description", actions13);
+        rv = mlm_client_send(producer, "Expiring", &expiring);
+        REQUIRE(rv == 0);
+    }
+    std::map<std::string, std::string> expired = test_list_severities(ui, "RESOLVED", "Expiring");
+    CHECK(expired.size() == 1);
+    CHECK(expired.count("expiring-ups-2") == 1);
+    std::map<std::string, std::string> kept = test_list_severities(ui, "ALL-ACTIVE", "Expiring");
+    CHECK(kept.size() == 1);
+    CHECK(kept.count("expiring-ups-1") == 1);
+
+    // Internal metrics: the requests and deliveries so far are counted
+    send = zmsg_new();
+    zmsg_addstr(send, "METRICS");
+    zmsg_addstr(send, "1237");
+    rv = mlm_client_sendto(ui, "fty-alert-list", "rfc-alerts-metrics", nullptr, 5000, &send);
+    REQUIRE(rv == 0);
+    reply = mlm_client_recv(ui);
+    REQUIRE(reply);
+    for (const char* expected : {"METRICS", "1237"}) {
+        part = zmsg_popstr(reply);
+        CHECK(streq(part, expected));
+        zstr_free(&part);
+    }
+    std::map<std::string, uint64_t> values;
+    while (zmsg_size(reply) >= 2) {
+        char* name   = zmsg_popstr(reply);
+        char* value  = zmsg_popstr(reply);
+        values[name] = strtoull(value, nullptr, 10);
+        zstr_free(&name);
+        zstr_free(&value);
+    }
+    zmsg_destroy(&reply);
+    CHECK(values["alerts.stored"] > 0);
+    CHECK(values["alerts.active"] > 0);
+    CHECK(values["alerts.active"] <= values["alerts.stored"]);
+    CHECK(values["stream.delivered"] > 0);
+    CHECK(values["stream.published"] > 0);
+    CHECK(values["list.requests"] > 0);
+    CHECK(values["ack.requests"] > 0);
+    CHECK(values["ack.confirmed"] > 0);
+    CHECK(values["ack.confirmed"] < values["ack.requests"]);
+    CHECK(values["ratelimit.suppressed"] >= 4);
+    CHECK(values.count("list.latency.p99") == 1);
+    CHECK(values["stream.deliver_latency.max"] >= values["stream.deliver_latency.p50"]);
+
+    // Retention: only the newest resolved alert of an element is kept, a tombstone is
+    // published for the other one
+    zmsg_t* retained = fty_proto_encode_alert(nullptr, 19, 0, "Retained1", "retention-ups", "RESOLVED", "high",
+        "description", actions13);
+    rv = mlm_client_send(producer, "Retained1", &retained);
+    REQUIRE(rv == 0);
+    decoded = test_recv_published(consumer, "Retained1");
+    fty_proto_destroy(&decoded);
+    retained = fty_proto_encode_alert(nullptr, 20, 0, "Retained2", "retention-ups", "RESOLVED", "high",
+        "description", actions13);
+    rv = mlm_client_send(producer, "Retained2", &retained);
+    REQUIRE(rv == 0);
+    decoded = test_recv_published(consumer, "Retained2");
+    fty_proto_destroy(&decoded);
+
+    zstr_sendx(fty_al_server_stream, "RETENTION", "0", "0", "1", nullptr);
+    decoded = test_recv_published(consumer, "Retained1");
+    CHECK(streq(fty_proto_state(decoded), "RESOLVED"));
+    CHECK(streq(fty_proto_aux_string(decoded, "purged", "0"), "1"));
+    fty_proto_destroy(&decoded);
+
+    // purged alert is not known anymore, the newest one is
+    test_request_alerts_acknowledge(ui, consumer, "Retained1", "retention-ups", "ACK-WIP", testAlerts, 1);
+    send = zmsg_new();
+    zmsg_addstr(send, "Retained2");
+    zmsg_addstr(send, "retention-ups");
+    zmsg_addstr(send, "ACK-WIP");
+    rv = mlm_client_sendto(ui, "fty-alert-list", RFC_ALERTS_ACKNOWLEDGE_SUBJECT, nullptr, 5000, &send);
+    REQUIRE(rv == 0);
+    reply = mlm_client_recv(ui);
+    part  = zmsg_popstr(reply);
+    CHECK(streq(part, "ERROR"));
+    zstr_free(&part);
+    part = zmsg_popstr(reply);
+    CHECK(streq(part, "BAD_STATE"));
+    zstr_free(&part);
+    zmsg_destroy(&reply);
+
+    // Alerts of one rule on many elements are spread over the partitions, their deliveries
+    // are applied concurrently and all of them are listed; readers see each of them (in the
+    // snapshot published once per batch) before consumers of ALERTS do
+    for (int i = 0; i < 32; i++) {
+        std::string element = "spread-ups-" + std::to_string(i);
+        zmsg_t*     spread  = fty_proto_encode_alert(
+            nullptr, 30, 0, "Spread", element.c_str(), "ACTIVE", "high", "description", actions13);
+        rv = mlm_client_send(producer, "Spread", &spread);
+        REQUIRE(rv == 0);
+    }
+    for (int spreadCount = 0; spreadCount < 32;) {
+        zmsg_t* zmessage = mlm_client_recv(consumer);
+        REQUIRE(zmessage);
+        decoded = fty_proto_decode(&zmessage);
+        REQUIRE(decoded);
+        if (streq(fty_proto_rule(decoded), "Spread")) {
+            std::map<std::string, std::string> listed = test_list_severities(ui, "ALL-ACTIVE", "Spread");
+            CHECK(listed.count(fty_proto_name(decoded)) == 1);
+            spreadCount++;
+        }
+        fty_proto_destroy(&decoded);
+    }
+
+    // a delivery identifying one of them with another case lands in its partition
+    zmsg_t* spread =
+        fty_proto_encode_alert(nullptr, 31, 0, "SPREAD", "Spread-UPS-3", "ACTIVE", "low", "description", actions13);
+    rv = mlm_client_send(producer, "SPREAD", &spread);
+    REQUIRE(rv == 0);
+    decoded = test_recv_published(consumer, "SPREAD");
+    CHECK(streq(fty_proto_severity(decoded), "low"));
+    fty_proto_destroy(&decoded);
+
+    std::map<std::string, std::string> severities = test_list_severities(ui, "ALL-ACTIVE", "Spread");
+    CHECK(severities.size() == 32);
+    for (int i = 0; i < 32; i++) {
+        std::string element = "spread-ups-" + std::to_string(i);
+        CHECK(severities[element] == (i == 3 ? "low" : "high"));
+    }
+
     zlistx_destroy(&testAlerts);
 
     save_alerts();
@@ -847,6 +1274,7 @@ TEST_CASE("alert list server test")
     mlm_client_destroy(&ui);
     zactor_destroy(&server);
     destroy_alert();
+    test_remove_dir(SELFTEST_STATE);
 
     if (nullptr != actions1)
         zlist_destroy(&actions1);
@@ -872,6 +1300,8 @@ TEST_CASE("alert list server test")
         zlist_destroy(&actions11);
     if (nullptr != actions12)
         zlist_destroy(&actions12);
+    if (nullptr != actions13)
+        zlist_destroy(&actions13);
 
     printf("OK\n");
 }
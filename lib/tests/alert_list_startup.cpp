@@ -0,0 +1,189 @@
+#include <catch2/catch.hpp>
+#include "src/fty_alert_list_server.h"
+#include "src/alerts_utils.h"
+#include <fty_proto.h>
+#include <malamute.h>
+#include <map>
+#include <string>
+#include <vector>
+
+#define SELFTEST_STATE "./test_alert_list_startup"
+
+#define RFC_ALERTS_LIST_SUBJECT        "rfc-alerts-list"
+#define RFC_ALERTS_ACKNOWLEDGE_SUBJECT "rfc-alerts-acknowledge"
+#define RFC_ALERTS_METRICS_SUBJECT     "rfc-alerts-metrics"
+
+// alerts stored in the state file
+#define TEST_ALERTS 5000
+
+// remove directory 'path' and its content
+static void test_remove_dir(const char* path)
+{
+    zdir_t* dir = zdir_new(path, "-");
+    if (dir) {
+        zdir_remove(dir, true);
+        zdir_destroy(&dir);
+    }
+}
+
+// publish alert ('rule', 'element')
+static void test_deliver(mlm_client_t* producer, const char* rule, const char* element, const char* severity,
+    const char* state = "ACTIVE")
+{
+    zlist_t* actions = zlist_new();
+    zlist_autofree(actions);
+    zlist_append(actions, const_cast<char*>("EMAIL"));
+    zmsg_t* msg = fty_proto_encode_alert(
+        nullptr, uint64_t(zclock_time() / 1000), 0, rule, element, state, severity, "description", actions);
+    zlist_destroy(&actions);
+    std::string subject = std::string(rule) + "/" + severity + "@" + element;
+    REQUIRE(mlm_client_send(producer, subject.c_str(), &msg) == 0);
+}
+
+// publications on ALERTS, "state/severity" in their order by element, received until
+// 'count' of them
+static std::map<std::string, std::vector<std::string>> test_published(mlm_client_t* consumer, int count)
+{
+    std::map<std::string, std::vector<std::string>> published;
+    for (int i = 0; i < count; i++) {
+        zmsg_t* msg = mlm_client_recv(consumer);
+        REQUIRE(msg);
+        fty_proto_t* decoded = fty_proto_decode(&msg);
+        REQUIRE(decoded);
+        published[fty_proto_name(decoded)].push_back(
+            std::string(fty_proto_state(decoded)) + "/" + fty_proto_severity(decoded));
+        fty_proto_destroy(&decoded);
+    }
+    return published;
+}
+
+// listed alerts, "state/severity" by "rule/element"
+static std::map<std::string, std::string> test_list(mlm_client_t* ui)
+{
+    zmsg_t* send = zmsg_new();
+    zmsg_addstr(send, "LIST");
+    zmsg_addstr(send, "ALL");
+    REQUIRE(mlm_client_sendto(ui, "fty-alert-list", RFC_ALERTS_LIST_SUBJECT, nullptr, 5000, &send) == 0);
+    zmsg_t* reply = mlm_client_recv(ui);
+    REQUIRE(reply);
+    CHECK(streq(mlm_client_subject(ui), RFC_ALERTS_LIST_SUBJECT));
+    char* part = zmsg_popstr(reply);
+    CHECK(streq(part, "LIST"));
+    zstr_free(&part);
+    part = zmsg_popstr(reply);
+    CHECK(streq(part, "ALL"));
+    zstr_free(&part);
+
+    std::map<std::string, std::string> listed;
+    zframe_t*                          frame = zmsg_pop(reply);
+    while (frame) {
+#if CZMQ_VERSION_MAJOR == 3
+        zmsg_t* decoded_zmsg = zmsg_decode(zframe_data(frame), zframe_size(frame));
+#else
+        zmsg_t* decoded_zmsg = zmsg_decode(frame);
+#endif
+        zframe_destroy(&frame);
+        REQUIRE(decoded_zmsg);
+        fty_proto_t* decoded = fty_proto_decode(&decoded_zmsg);
+        REQUIRE(decoded);
+        listed[std::string(fty_proto_rule(decoded)) + "/" + fty_proto_name(decoded)] =
+            std::string(fty_proto_state(decoded)) + "/" + fty_proto_severity(decoded);
+        fty_proto_destroy(&decoded);
+        frame = zmsg_pop(reply);
+    }
+    zmsg_destroy(&reply);
+    return listed;
+}
+
+TEST_CASE("alert list startup test")
+{
+    static const char* endpoint = "inproc://fty-lm-startup-test";
+
+    test_remove_dir(SELFTEST_STATE);
+    zsys_dir_create(SELFTEST_STATE);
+
+    // state file of the previous run
+    zlistx_t* alerts = zlistx_new();
+    zlistx_set_destructor(alerts, reinterpret_cast<czmq_destructor*>(fty_proto_destroy));
+    zlistx_set_duplicator(alerts, reinterpret_cast<czmq_duplicator*>(fty_proto_dup));
+    for (int i = 0; i < TEST_ALERTS; i++) {
+        std::string  element = "ups-" + std::to_string(i);
+        fty_proto_t* alert   = alert_new("Startup", element.c_str(), "ACTIVE", "high", "saved", 1, nullptr, 0);
+        zlistx_add_end(alerts, alert);
+        fty_proto_destroy(&alert);
+    }
+    REQUIRE(alert_save_state(alerts, SELFTEST_STATE, "state_file", false) == 0);
+    zlistx_destroy(&alerts);
+
+    zactor_t* server = zactor_new(mlm_server, const_cast<char*>("Malamute"));
+    zstr_sendx(server, "BIND", endpoint, nullptr);
+
+    mlm_client_t* producer = mlm_client_new();
+    REQUIRE(mlm_client_connect(producer, endpoint, 1000, "PRODUCER") == 0);
+    REQUIRE(mlm_client_set_producer(producer, "_ALERTS_SYS") == 0);
+    mlm_client_t* consumer = mlm_client_new();
+    REQUIRE(mlm_client_connect(consumer, endpoint, 1000, "CONSUMER") == 0);
+    REQUIRE(mlm_client_set_consumer(consumer, "ALERTS", ".*") == 0);
+    mlm_client_t* ui = mlm_client_new();
+    REQUIRE(mlm_client_connect(ui, endpoint, 1000, "UI") == 0);
+
+    init_alert_private(SELFTEST_STATE, "state_file", false, 2);
+    zactor_t* mailbox = zactor_new(fty_alert_list_server_mailbox, const_cast<char*>(endpoint));
+    zactor_t* stream  = zactor_new(fty_alert_list_server_stream, const_cast<char*>(endpoint));
+
+    // deliveries and requests right at startup, while the state file loads: deliveries are
+    // applied on top of the loaded alerts, requests wait for the alerts they are about
+    test_deliver(producer, "Startup", "ups-0", "low");
+    test_deliver(producer, "Startup", "new-ups", "high");
+    test_deliver(producer, "Startup", "short-ups", "high");
+    test_deliver(producer, "Startup", "short-ups", "high", "RESOLVED");
+
+    zmsg_t* send = zmsg_new();
+    zmsg_addstr(send, "Startup");
+    zmsg_addstr(send, "ups-1");
+    zmsg_addstr(send, "ACK-WIP");
+    REQUIRE(mlm_client_sendto(ui, "fty-alert-list", RFC_ALERTS_ACKNOWLEDGE_SUBJECT, nullptr, 5000, &send) == 0);
+    zmsg_t* reply = mlm_client_recv(ui);
+    REQUIRE(reply);
+    CHECK(streq(mlm_client_subject(ui), RFC_ALERTS_ACKNOWLEDGE_SUBJECT));
+    char* ok = zmsg_popstr(reply);
+    CHECK(streq(ok, "OK"));
+    zstr_free(&ok);
+    zmsg_destroy(&reply);
+
+    // metrics do not need the store
+    send = zmsg_new();
+    zmsg_addstr(send, "METRICS");
+    zmsg_addstr(send, "1234");
+    REQUIRE(mlm_client_sendto(ui, "fty-alert-list", RFC_ALERTS_METRICS_SUBJECT, nullptr, 5000, &send) == 0);
+    reply = mlm_client_recv(ui);
+    REQUIRE(reply);
+    CHECK(streq(mlm_client_subject(ui), RFC_ALERTS_METRICS_SUBJECT));
+    zmsg_destroy(&reply);
+
+    // every delivery is published, the short lived alert was ACTIVE before being RESOLVED,
+    // the acknowledgement is published too
+    std::map<std::string, std::vector<std::string>> published = test_published(consumer, 5);
+    CHECK(published["ups-0"] == std::vector<std::string>({"ACTIVE/low"}));
+    CHECK(published["new-ups"] == std::vector<std::string>({"ACTIVE/high"}));
+    CHECK(published["short-ups"] == std::vector<std::string>({"ACTIVE/high", "RESOLVED/high"}));
+    CHECK(published["ups-1"] == std::vector<std::string>({"ACK-WIP/high"}));
+
+    // the delivery of a loaded alert replaced it, the new ones were added
+    std::map<std::string, std::string> listed = test_list(ui);
+    CHECK(listed.size() == TEST_ALERTS + 2);
+    CHECK(listed["Startup/ups-0"] == "ACTIVE/low");
+    CHECK(listed["Startup/ups-1"] == "ACK-WIP/high");
+    CHECK(listed["Startup/ups-2"] == "ACTIVE/high");
+    CHECK(listed["Startup/new-ups"] == "ACTIVE/high");
+    CHECK(listed["Startup/short-ups"] == "RESOLVED/high");
+
+    zactor_destroy(&stream);
+    zactor_destroy(&mailbox);
+    mlm_client_destroy(&ui);
+    mlm_client_destroy(&consumer);
+    mlm_client_destroy(&producer);
+    zactor_destroy(&server);
+    destroy_alert();
+    test_remove_dir(SELFTEST_STATE);
+}
@@ -1,6 +1,11 @@
+#include "src/alerts_journal.h"
 #include "src/alerts_utils.h"
 #include <catch2/catch.hpp>
+#include <fcntl.h>
 #include <fty_common_utf8.h>
+#include <string>
+#include <sys/stat.h>
+#include <unistd.h>
 
 TEST_CASE("alerts utils test")
 {
@@ -1209,6 +1214,185 @@ TEST_CASE("alerts utils test")
             zlist_destroy(&actions6);
     }
 
+    // Binary state file: aux items kept, corrupted records skipped, corrupted header rejected
+    {
+        zlistx_t* alerts = zlistx_new();
+        CHECK(alerts);
+        zlistx_set_destructor(alerts, reinterpret_cast<czmq_destructor*>(fty_proto_destroy));
+        zlistx_set_duplicator(alerts, reinterpret_cast<czmq_duplicator*>(fty_proto_dup));
+        fty_proto_t* alert = alert_new("Rule1", "Element1", "ACTIVE", "high", "{ \"key\": \"value\" }", 1, nullptr, 60);
+        fty_proto_set_metadata(alert, "%s", "UTF-8: HЯɅȤ");
+        zlistx_add_end(alerts, alert);
+        fty_proto_destroy(&alert);
+        alert = alert_new("Rule2", "Element1", "RESOLVED", "low", "xyz", 2, nullptr, 0);
+        zlistx_add_end(alerts, alert);
+        fty_proto_destroy(&alert);
+        CHECK(alert_save_state(alerts, SELFTEST_RW, "test_state_file", false) == 0);
+        zlistx_purge(alerts);
+
+        CHECK(alert_load_state(alerts, SELFTEST_RW, "test_state_file") == 0);
+        CHECK(zlistx_size(alerts) == 2);
+        fty_proto_t* cursor = reinterpret_cast<fty_proto_t*>(zlistx_first(alerts));
+        CHECK(streq(fty_proto_description(cursor), "{ \"key\": \"value\" }"));
+        CHECK(streq(fty_proto_metadata(cursor), "UTF-8: HЯɅȤ"));
+        CHECK(fty_proto_aux_number(cursor, "TTL", 0) == 60);
+        zlistx_purge(alerts);
+
+        // flip the last byte of the last record
+        FILE* file = fopen(SELFTEST_RW "/test_state_file", "r+b");
+        CHECK(file);
+        fseek(file, -5, SEEK_END);
+        int c = fgetc(file);
+        fseek(file, -5, SEEK_END);
+        fputc(c ^ 0xFF, file);
+        fclose(file);
+        CHECK(alert_load_state(alerts, SELFTEST_RW, "test_state_file") == 0);
+        CHECK(zlistx_size(alerts) == 1);
+        zlistx_purge(alerts);
+
+        // nothing is left behind by the atomic replacement
+        CHECK(!zsys_file_exists(SELFTEST_RW "/test_state_file.tmp"));
+
+        // a truncated file loads nothing, not even its first records
+        file = fopen(SELFTEST_RW "/test_state_file", "rb");
+        CHECK(file);
+        fseek(file, 0, SEEK_END);
+        long size = ftell(file);
+        fclose(file);
+        CHECK(truncate(SELFTEST_RW "/test_state_file", size - 3) == 0);
+        CHECK(alert_load_state(alerts, SELFTEST_RW, "test_state_file") == -1);
+        CHECK(zlistx_size(alerts) == 0);
+
+        // flip a byte of the header
+        file = fopen(SELFTEST_RW "/test_state_file", "r+b");
+        CHECK(file);
+        fseek(file, 10, SEEK_SET);
+        c = fgetc(file);
+        fseek(file, 10, SEEK_SET);
+        fputc(c ^ 0xFF, file);
+        fclose(file);
+        CHECK(alert_load_state(alerts, SELFTEST_RW, "test_state_file") == -1);
+        CHECK(zlistx_size(alerts) == 0);
+        zlistx_destroy(&alerts);
+    }
+
+    // Duplicates (rule is case insensitive) are dropped on load
+    {
+        zlistx_t* alerts = zlistx_new();
+        CHECK(alerts);
+        zlistx_set_destructor(alerts, reinterpret_cast<czmq_destructor*>(fty_proto_destroy));
+        zlistx_set_duplicator(alerts, reinterpret_cast<czmq_duplicator*>(fty_proto_dup));
+        for (int i = 0; i < 1000; i++) {
+            std::string  rule    = i < 500 ? "Rule1" : "RULE1";
+            std::string  element = "Element" + std::to_string(i % 500);
+            fty_proto_t* alert   = alert_new(rule.c_str(), element.c_str(), "ACTIVE", "high", "x", 1, nullptr, 0);
+            zlistx_add_end(alerts, alert);
+            fty_proto_destroy(&alert);
+        }
+        CHECK(alert_save_state(alerts, SELFTEST_RW, "test_state_file", false) == 0);
+        zlistx_purge(alerts);
+
+        CHECK(alert_load_state(alerts, SELFTEST_RW, "test_state_file") == 0);
+        CHECK(zlistx_size(alerts) == 500);
+        fty_proto_t* cursor = reinterpret_cast<fty_proto_t*>(zlistx_first(alerts));
+        CHECK(streq(fty_proto_rule(cursor), "Rule1"));
+        zlistx_destroy(&alerts);
+    }
+
+    // Legacy state file (64-bit size, encoded alert) with records over 255 bytes
+    {
+        std::string description(1000, 'x');
+        std::string legacy;
+        for (const char* element : {"Element1", "Element2"}) {
+            fty_proto_t* alert   = alert_new("Rule1", element, "ACTIVE", "high", description.c_str(), 1, nullptr, 0);
+            std::string  encoded = alert_encode_frame(alert);
+            fty_proto_destroy(&alert);
+            for (int i = 0; i < 8; i++)
+                legacy.push_back(char((uint64_t(encoded.size()) >> (8 * i)) & 0xFF));
+            legacy.append(encoded);
+        }
+        FILE* file = fopen(SELFTEST_RW "/test_legacy_state_file", "wb");
+        CHECK(file);
+        fwrite(legacy.data(), 1, legacy.size(), file);
+        fclose(file);
+
+        zlistx_t* alerts = zlistx_new();
+        CHECK(alerts);
+        zlistx_set_destructor(alerts, reinterpret_cast<czmq_destructor*>(fty_proto_destroy));
+        zlistx_set_duplicator(alerts, reinterpret_cast<czmq_duplicator*>(fty_proto_dup));
+        CHECK(alert_load_state(alerts, SELFTEST_RW, "test_legacy_state_file") == 0);
+        CHECK(zlistx_size(alerts) == 2);
+        fty_proto_t* cursor = reinterpret_cast<fty_proto_t*>(zlistx_last(alerts));
+        CHECK(streq(fty_proto_name(cursor), "Element2"));
+        CHECK(description == fty_proto_description(cursor));
+        zlistx_purge(alerts);
+
+        // the record running past the end of the file is ignored
+        CHECK(truncate(SELFTEST_RW "/test_legacy_state_file", off_t(legacy.size() - 1)) == 0);
+        CHECK(alert_load_state(alerts, SELFTEST_RW, "test_legacy_state_file") == 0);
+        CHECK(zlistx_size(alerts) == 1);
+        zlistx_destroy(&alerts);
+    }
+
+    // State handed off in shared memory
+    {
+        zlistx_t* alerts = zlistx_new();
+        CHECK(alerts);
+        zlistx_set_destructor(alerts, reinterpret_cast<czmq_destructor*>(fty_proto_destroy));
+        zlistx_set_duplicator(alerts, reinterpret_cast<czmq_duplicator*>(fty_proto_dup));
+        fty_proto_t* alert = alert_new("Rule1", "Element1", "ACTIVE", "high", "saved", 1, nullptr, 0);
+        zlistx_add_end(alerts, alert);
+        fty_proto_destroy(&alert);
+        CHECK(alert_save_state(alerts, SELFTEST_RW, "test_handoff_state", false) == 0);
+        zlistx_purge(alerts);
+
+        AlertState handoff;
+        alert = alert_new("Rule1", "Element1", "ACK-WIP", "high", "handed off", 1, nullptr, 0);
+        alert_state_add(handoff, alert);
+        fty_proto_destroy(&alert);
+        // a link left in place of the temporary file is not written through
+        CHECK(symlink("test_handoff_target", SELFTEST_RW "/test_handoff.tmp") == 0);
+        CHECK(alert_state_save(handoff, SELFTEST_RW, "test_handoff", 0600) == 0);
+        CHECK(access(SELFTEST_RW "/test_handoff_target", F_OK) != 0);
+        struct stat st;
+        CHECK(stat(SELFTEST_RW "/test_handoff", &st) == 0);
+        CHECK((st.st_mode & 07777) == 0600);
+
+        CHECK(alert_load_handoff(alerts, SELFTEST_RW, "test_handoff", SELFTEST_RW, "test_handoff_state") == 0);
+        CHECK(zlistx_size(alerts) == 1);
+        CHECK(streq(fty_proto_description(reinterpret_cast<fty_proto_t*>(zlistx_first(alerts))), "handed off"));
+        zlistx_purge(alerts);
+
+        // saved before the state file, it is stale
+        struct timespec older[2] = {{0, UTIME_OMIT}, {1, 0}};
+        CHECK(utimensat(AT_FDCWD, SELFTEST_RW "/test_handoff", older, 0) == 0);
+        CHECK(alert_load_handoff(alerts, SELFTEST_RW, "test_handoff", SELFTEST_RW, "test_handoff_state") == 1);
+        CHECK(zlistx_size(alerts) == 0);
+        struct timespec now[2] = {{0, UTIME_OMIT}, {0, UTIME_NOW}};
+        CHECK(utimensat(AT_FDCWD, SELFTEST_RW "/test_handoff", now, 0) == 0);
+
+        // without a state file, a handoff is not known to be recent
+        CHECK(alert_load_handoff(alerts, SELFTEST_RW, "test_handoff", SELFTEST_RW, "does_not_exist") == 1);
+
+        // readable by others (it might have been written by them)
+        CHECK(chmod(SELFTEST_RW "/test_handoff", 0644) == 0);
+        CHECK(alert_load_handoff(alerts, SELFTEST_RW, "test_handoff", SELFTEST_RW, "test_handoff_state") == 1);
+        CHECK(chmod(SELFTEST_RW "/test_handoff", 0600) == 0);
+
+        // links are not followed
+        CHECK(symlink("test_handoff", SELFTEST_RW "/test_handoff_link") == 0);
+        CHECK(alert_load_handoff(alerts, SELFTEST_RW, "test_handoff_link", SELFTEST_RW, "test_handoff_state") == 1);
+        CHECK(alert_load_handoff(alerts, SELFTEST_RW, "does_not_exist", SELFTEST_RW, "test_handoff_state") == 1);
+        CHECK(zlistx_size(alerts) == 0);
+
+        CHECK(alert_load_handoff(alerts, SELFTEST_RW, "test_handoff", SELFTEST_RW, "test_handoff_state") == 0);
+        CHECK(zlistx_size(alerts) == 1);
+        zlistx_destroy(&alerts);
+        unlink(SELFTEST_RW "/test_handoff_link");
+        unlink(SELFTEST_RW "/test_handoff");
+        unlink(SELFTEST_RW "/test_handoff_state");
+    }
+
     // Test case #2:
     //  file does not exist
     {
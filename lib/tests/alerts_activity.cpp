@@ -0,0 +1,169 @@
+#include "src/alerts_activity.h"
+#include <catch2/catch.hpp>
+#include <czmq.h>
+#include <fcntl.h>
+#include <string>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define SELFTEST_RW "."
+
+static int test_activity_count(const std::string& path, uint64_t from, uint64_t to, const char* element = nullptr,
+    const char* filename = "state")
+{
+    return alert_activity_query(path.c_str(), filename, from, to, element, [](const AlertActivity&) {
+        return true;
+    });
+}
+
+static int64_t test_file_size(const std::string& file)
+{
+    struct stat st;
+    return stat(file.c_str(), &st) == 0 ? int64_t(st.st_size) : -1;
+}
+
+TEST_CASE("alerts activity test")
+{
+    const std::string path  = SELFTEST_RW "/test_activity";
+    const std::string file  = path + "/state.activity";
+    const std::string index = path + "/state.activity.index";
+    zsys_dir_create("%s", path.c_str());
+    unlink(file.c_str());
+    unlink(index.c_str());
+
+    // no log yet
+    CHECK(test_activity_count(path, 0, UINT64_MAX) == 0);
+
+    // periods of 5 s every 10 s, the 11th one lasts long
+    AlertActivityLog log;
+    REQUIRE(alert_activity_open(log, path.c_str(), "state") == 0);
+    for (int batch = 0; batch < 3; batch++) {
+        std::vector<AlertActivity> periods;
+        for (int i = batch * 50; i < (batch + 1) * 50; i++) {
+            AlertActivity period;
+            period.start    = i == 10 ? 0 : uint64_t(1000 + 10 * i);
+            period.end      = i == 10 ? 100000 : uint64_t(1005 + 10 * i);
+            period.rule     = "Rule" + std::to_string(i);
+            period.element  = i % 2 ? "Element1" : "Element2";
+            period.severity = "high";
+            periods.push_back(period);
+        }
+        CHECK(alert_activity_append(log, periods) == 0);
+    }
+    alert_activity_close(log);
+
+    // two complete blocks are indexed
+    struct stat st;
+    REQUIRE(stat(index.c_str(), &st) == 0);
+    CHECK(st.st_size == 2 * 32);
+
+    // overlapping periods
+    CHECK(test_activity_count(path, 0, UINT64_MAX) == 150);
+    CHECK(test_activity_count(path, 1000, 1004) == 2);
+    CHECK(test_activity_count(path, 1500, 1600) == 12);
+    CHECK(test_activity_count(path, 5000, 6000) == 1);
+    CHECK(test_activity_count(path, 100000, 100000) == 1);
+    CHECK(test_activity_count(path, 100001, 200000) == 0);
+    CHECK(test_activity_count(path, 0, UINT64_MAX, "element1") == 75);
+    CHECK(test_activity_count(path, 2000, 1000) == -1);
+
+    // periods found, until the callback stops
+    int count = alert_activity_query(path.c_str(), "state", 2400, 2500, "Element2", [](const AlertActivity& period) {
+        CHECK(period.element == "Element2");
+        CHECK(period.severity == "high");
+        CHECK(period.start <= 2500);
+        CHECK(period.end >= 2400);
+        return false;
+    });
+    CHECK(count == 1);
+
+    // incomplete period of an interrupted write is dropped, then appended to again
+    {
+        int fd = open(file.c_str(), O_WRONLY | O_APPEND);
+        REQUIRE(fd != -1);
+        CHECK(write(fd, "\x20\0\0\0garbage", 11) == 11);
+        close(fd);
+        CHECK(test_activity_count(path, 0, UINT64_MAX) == 150);
+
+        REQUIRE(alert_activity_open(log, path.c_str(), "state") == 0);
+        AlertActivity period;
+        period.start    = 3000;
+        period.end      = 3010;
+        period.rule     = "Rule150";
+        period.element  = "Element3";
+        period.severity = "low";
+        CHECK(alert_activity_append(log, {period}) == 0);
+        alert_activity_close(log);
+        CHECK(test_activity_count(path, 0, UINT64_MAX) == 151);
+        CHECK(test_activity_count(path, 3005, 3005, "Element3") == 1);
+    }
+
+    // blocks of periods ended before the retention age are dropped, once they make half
+    // of the log
+    {
+        const std::string expireFile  = path + "/expire.activity";
+        const std::string expireIndex = path + "/expire.activity.index";
+        unlink(expireFile.c_str());
+        unlink(expireIndex.c_str());
+
+        // 10 blocks of periods of 5 s every 10 s, the last one being filled
+        REQUIRE(alert_activity_open(log, path.c_str(), "expire") == 0);
+        std::vector<AlertActivity> periods;
+        for (int i = 0; i < 10 * ALERT_ACTIVITY_BLOCK; i++) {
+            AlertActivity period;
+            period.start    = uint64_t(1000 + 10 * i);
+            period.end      = uint64_t(1005 + 10 * i);
+            period.rule     = "Rule";
+            period.element  = "Element1";
+            period.severity = "high";
+            periods.push_back(period);
+        }
+        CHECK(alert_activity_append(log, periods) == 0);
+        CHECK(test_file_size(expireIndex) == 9 * 32);
+        int64_t size = test_file_size(expireFile);
+
+        // 3 blocks ended before: kept
+        CHECK(alert_activity_expire(log, path.c_str(), "expire", 1000 + 10 * 3 * ALERT_ACTIVITY_BLOCK) == 0);
+        CHECK(test_file_size(expireFile) == size);
+        CHECK(test_activity_count(path, 0, UINT64_MAX, nullptr, "expire") == 10 * ALERT_ACTIVITY_BLOCK);
+
+        // 6 blocks ended before: dropped, the others are still found by the index
+        uint64_t before = 1000 + 10 * 6 * ALERT_ACTIVITY_BLOCK;
+        CHECK(alert_activity_expire(log, path.c_str(), "expire", before) == 0);
+        CHECK(test_file_size(expireFile) == size * 4 / 10);
+        CHECK(test_file_size(expireIndex) == 3 * 32);
+        CHECK(test_file_size(expireFile + ".tmp") == -1);
+        CHECK(test_file_size(expireIndex + ".tmp") == -1);
+        CHECK(test_activity_count(path, 0, UINT64_MAX, nullptr, "expire") == 4 * ALERT_ACTIVITY_BLOCK);
+        CHECK(test_activity_count(path, 0, before - 1, nullptr, "expire") == 0);
+        CHECK(test_activity_count(path, before, before, nullptr, "expire") == 1);
+
+        // the log is appended to as before
+        AlertActivity period;
+        period.start    = 100000;
+        period.end      = 100010;
+        period.rule     = "Rule";
+        period.element  = "Element2";
+        period.severity = "low";
+        CHECK(alert_activity_append(log, {period}) == 0);
+        alert_activity_close(log);
+        CHECK(test_file_size(expireIndex) == 4 * 32);
+        CHECK(test_activity_count(path, 0, UINT64_MAX, nullptr, "expire") == 4 * ALERT_ACTIVITY_BLOCK + 1);
+
+        // an index removed by an interrupted expiry is rebuilt
+        unlink(expireIndex.c_str());
+        CHECK(test_activity_count(path, 0, UINT64_MAX, nullptr, "expire") == 4 * ALERT_ACTIVITY_BLOCK + 1);
+        REQUIRE(alert_activity_open(log, path.c_str(), "expire") == 0);
+        alert_activity_close(log);
+        CHECK(test_file_size(expireIndex) == 4 * 32);
+        CHECK(test_activity_count(path, before, before, nullptr, "expire") == 1);
+        CHECK(test_activity_count(path, 100005, 100005, "Element2", "expire") == 1);
+
+        unlink(expireFile.c_str());
+        unlink(expireIndex.c_str());
+    }
+
+    unlink(file.c_str());
+    unlink(index.c_str());
+    rmdir(path.c_str());
+}
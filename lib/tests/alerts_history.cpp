@@ -0,0 +1,133 @@
+#include "src/alerts_history.h"
+#include "src/alerts_utils.h"
+#include <catch2/catch.hpp>
+#include <fcntl.h>
+#include <string>
+#include <unistd.h>
+
+#define SELFTEST_RW "."
+
+static zlistx_t* test_alerts_new()
+{
+    zlistx_t* alerts = zlistx_new();
+    zlistx_set_destructor(alerts, reinterpret_cast<czmq_destructor*>(fty_proto_destroy));
+    zlistx_set_duplicator(alerts, reinterpret_cast<czmq_duplicator*>(fty_proto_dup));
+    return alerts;
+}
+
+static void test_alerts_add(zlistx_t* alerts, const char* rule, const char* element, uint64_t time)
+{
+    fty_proto_t* alert = alert_new(rule, element, "RESOLVED", "high", "history", time, nullptr, 0);
+    REQUIRE(alert);
+    zlistx_add_end(alerts, alert);
+    fty_proto_destroy(&alert);
+}
+
+TEST_CASE("alerts history test")
+{
+    const std::string path = SELFTEST_RW "/test_history";
+    zsys_dir_create("%s", path.c_str());
+    // 2020-01-01, 2020-01-02 and 2020-01-03 (UTC)
+    const uint64_t day1 = 1577836800;
+    const uint64_t day2 = day1 + 86400;
+    const uint64_t day3 = day2 + 86400;
+    for (const char* name : {"history.20200101", "history.20200102"})
+        unlink((path + "/" + name).c_str());
+
+    // two moves, the first one spread over two days
+    {
+        zlistx_t* alerts = test_alerts_new();
+        test_alerts_add(alerts, "Rule1", "Element1", day1 + 10);
+        test_alerts_add(alerts, "Rule2", "Element1", day1 + 20);
+        test_alerts_add(alerts, "Rule1", "Element2", day2 + 10);
+        CHECK(alert_history_append(path.c_str(), alerts) == 0);
+        zlistx_destroy(&alerts);
+
+        alerts = test_alerts_new();
+        test_alerts_add(alerts, "Rule3", "Element2", day2 + 20);
+        // moved again, listed once
+        test_alerts_add(alerts, "Rule1", "Element1", day1 + 10);
+        CHECK(alert_history_append(path.c_str(), alerts) == 0);
+        zlistx_destroy(&alerts);
+    }
+    CHECK(zsys_file_exists((path + "/history.20200101").c_str()));
+    CHECK(zsys_file_exists((path + "/history.20200102").c_str()));
+    CHECK(!zsys_file_exists((path + "/history.20200103").c_str()));
+
+    // time ranges
+    {
+        zlistx_t* alerts = test_alerts_new();
+        CHECK(alert_history_query(path.c_str(), day1, day3, nullptr, alerts) == 4);
+        zlistx_purge(alerts);
+        CHECK(alert_history_query(path.c_str(), day1 + 15, day2 + 15, nullptr, alerts) == 2);
+        fty_proto_t* cursor = reinterpret_cast<fty_proto_t*>(zlistx_first(alerts));
+        while (cursor) {
+            CHECK(fty_proto_time(cursor) >= day1 + 15);
+            CHECK(fty_proto_time(cursor) <= day2 + 15);
+            CHECK(streq(fty_proto_state(cursor), "RESOLVED"));
+            cursor = reinterpret_cast<fty_proto_t*>(zlistx_next(alerts));
+        }
+        zlistx_purge(alerts);
+        CHECK(alert_history_query(path.c_str(), day3, day3 + 100, nullptr, alerts) == 0);
+        CHECK(alert_history_query(path.c_str(), day2, day1, nullptr, alerts) == -1);
+        zlistx_destroy(&alerts);
+    }
+
+    // element and limit
+    {
+        zlistx_t* alerts = test_alerts_new();
+        CHECK(alert_history_query(path.c_str(), day1, day3, "element2", alerts) == 2);
+        zlistx_purge(alerts);
+        CHECK(alert_history_query(path.c_str(), day1, day3, nullptr, alerts, 3) == 3);
+        zlistx_destroy(&alerts);
+
+        // alerts are found until the caller has enough of them
+        int found = 0;
+        CHECK(alert_history_query(path.c_str(), day1, day3, nullptr, [&](fty_proto_t* alert) {
+            CHECK(streq(fty_proto_state(alert), "RESOLVED"));
+            return ++found < 2;
+        }) == 2);
+        CHECK(found == 2);
+    }
+
+    // incomplete block of an interrupted write is ignored, then replaced by the next move
+    {
+        std::string file = path + "/history.20200102";
+        int         fd   = open(file.c_str(), O_WRONLY | O_APPEND);
+        REQUIRE(fd != -1);
+        CHECK(write(fd, "\x40\0\0\0garbage", 11) == 11);
+        close(fd);
+
+        zlistx_t* alerts = test_alerts_new();
+        CHECK(alert_history_query(path.c_str(), day2, day3, nullptr, alerts) == 2);
+        zlistx_purge(alerts);
+
+        test_alerts_add(alerts, "Rule4", "Element3", day2 + 30);
+        CHECK(alert_history_append(path.c_str(), alerts) == 0);
+        zlistx_purge(alerts);
+        CHECK(alert_history_query(path.c_str(), day2, day3, nullptr, alerts) == 3);
+        zlistx_destroy(&alerts);
+    }
+
+    // block headers are covered by a crc32: a corrupted one is not trusted (nor what follows,
+    // it cannot be found), the next move replaces them
+    {
+        std::string file = path + "/history.20200101";
+        int         fd   = open(file.c_str(), O_RDWR);
+        REQUIRE(fd != -1);
+        CHECK(pwrite(fd, "\xff\xff\xff\x7f", 4, 12 + 4) == 4); // raw size of the first block
+        close(fd);
+
+        zlistx_t* alerts = test_alerts_new();
+        CHECK(alert_history_query(path.c_str(), day1, day1 + 100, nullptr, alerts) == 0);
+        test_alerts_add(alerts, "Rule5", "Element1", day1 + 30);
+        CHECK(alert_history_append(path.c_str(), alerts) == 0);
+        zlistx_purge(alerts);
+        CHECK(alert_history_query(path.c_str(), day1, day1 + 100, nullptr, alerts) == 1);
+        zlistx_destroy(&alerts);
+    }
+
+    for (const char* name : {"history.20200101", "history.20200102"})
+        unlink((path + "/" + name).c_str());
+    rmdir(path.c_str());
+}
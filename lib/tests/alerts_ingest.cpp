@@ -0,0 +1,93 @@
+#include "src/alerts_ingest.h"
+#include "src/alerts_utils.h"
+#include <catch2/catch.hpp>
+
+// queue a delivery of alert ('rule', 'element') in 'lane'
+static void test_ingest_push(
+    AlertIngestQueue& queue, int lane, const char* rule, const char* element, const char* state, uint64_t time)
+{
+    AlertIngestEntry entry;
+    entry.subject = rule;
+    entry.key     = alert_id_key(rule, element);
+    entry.alert   = alert_new(rule, element, state, "high", "ingested", time, nullptr, 0);
+    REQUIRE(entry.alert);
+    alert_ingest_push(queue, lane, std::move(entry));
+}
+
+TEST_CASE("alerts ingest test")
+{
+    // keys fold the case of rule and element, as is_alert_identified() does
+    CHECK(alert_id_key("Rule1", "Element1") == alert_id_key("rule1", "ELEMENT1"));
+    CHECK(alert_id_key("Rule1", "Element1") != alert_id_key("Rule1", "Element2"));
+    CHECK(alert_id_key("Rule1", "Element1") != alert_id_key("Rule1Element1", ""));
+    CHECK(alert_element_key("Element1") == alert_element_key("ELEMENT1"));
+    CHECK(alert_element_key("Element1") != alert_element_key("Element2"));
+
+    AlertIngestQueue queue;
+    AlertIngestEntry entry;
+    CHECK(!alert_ingest_pop(queue, entry));
+
+    // lanes are taken by priority, deliveries of a lane by arrival
+    test_ingest_push(queue, ALERT_LANE_REFRESH, "Refresh1", "ups", "ACTIVE", 1);
+    test_ingest_push(queue, ALERT_LANE_CHANGE, "Change1", "ups", "ACTIVE", 2);
+    test_ingest_push(queue, ALERT_LANE_REFRESH, "Refresh2", "ups", "ACTIVE", 3);
+    test_ingest_push(queue, ALERT_LANE_CRITICAL, "Critical1", "ups", "ACTIVE", 4);
+    test_ingest_push(queue, ALERT_LANE_CHANGE, "Change2", "ups", "ACTIVE", 5);
+    CHECK(queue.chains.size() == 5);
+    CHECK(queue.size == 5);
+
+    for (const char* expected : {"Critical1", "Change1", "Change2", "Refresh1", "Refresh2"}) {
+        REQUIRE(alert_ingest_pop(queue, entry));
+        CHECK(entry.subject == expected);
+        CHECK(streq(fty_proto_rule(entry.alert), expected));
+        fty_proto_destroy(&entry.alert);
+    }
+    CHECK(!alert_ingest_pop(queue, entry));
+    CHECK(queue.byKey.empty());
+
+    // deliveries of one alert are chained in order, the chain takes the place of the first
+    // one and the best lane of all; an unchanged refresh replaces the last queued delivery
+    test_ingest_push(queue, ALERT_LANE_CHANGE, "Change1", "ups", "ACTIVE", 6);
+    test_ingest_push(queue, ALERT_LANE_REFRESH, "Flappy", "ups", "ACTIVE", 7);
+    test_ingest_push(queue, ALERT_LANE_REFRESH, "flappy", "UPS", "ACTIVE", 8);
+    test_ingest_push(queue, ALERT_LANE_CHANGE, "Change2", "ups", "ACTIVE", 9);
+    test_ingest_push(queue, ALERT_LANE_CHANGE, "FLAPPY", "UPS", "RESOLVED", 10);
+    test_ingest_push(queue, ALERT_LANE_CHANGE, "flappy", "Ups", "ACTIVE", 11);
+    CHECK(queue.chains.size() == 3);
+    CHECK(queue.byKey.size() == 3);
+    CHECK(queue.size == 5);
+
+    REQUIRE(alert_ingest_pop(queue, entry));
+    CHECK(entry.subject == "Change1");
+    fty_proto_destroy(&entry.alert);
+    for (uint64_t time : {8, 10, 11}) {
+        REQUIRE(alert_ingest_pop(queue, entry));
+        CHECK(entry.key == alert_id_key("Flappy", "ups"));
+        CHECK(fty_proto_time(entry.alert) == time);
+        CHECK(streq(fty_proto_state(entry.alert), time == 10 ? "RESOLVED" : "ACTIVE"));
+        fty_proto_destroy(&entry.alert);
+    }
+
+    // a short lived alert (ACTIVE then RESOLVED) keeps both deliveries, a state change
+    // received in a worse lane is still applied after the earlier ones
+    test_ingest_push(queue, ALERT_LANE_CHANGE, "Short", "ups", "ACTIVE", 12);
+    test_ingest_push(queue, ALERT_LANE_CHANGE, "Short", "ups", "RESOLVED", 13);
+    test_ingest_push(queue, ALERT_LANE_REFRESH, "Short", "ups", "ACTIVE", 14);
+    CHECK(queue.size == 4);
+
+    // deliveries of an alert are taken ahead of the others (e.g. before a request on it)
+    CHECK(!alert_ingest_take(queue, alert_id_key("Unknown", "ups"), entry));
+    for (const char* state : {"ACTIVE", "RESOLVED", "ACTIVE"}) {
+        REQUIRE(alert_ingest_take(queue, alert_id_key("short", "UPS"), entry));
+        CHECK(streq(fty_proto_state(entry.alert), state));
+        fty_proto_destroy(&entry.alert);
+    }
+    CHECK(!alert_ingest_take(queue, alert_id_key("short", "UPS"), entry));
+    CHECK(queue.chains.size() == 1);
+    CHECK(queue.size == 1);
+
+    alert_ingest_clear(queue);
+    CHECK(queue.chains.empty());
+    CHECK(queue.byKey.empty());
+    CHECK(queue.size == 0);
+}
@@ -0,0 +1,159 @@
+#include "src/alerts_io.h"
+#include "src/alerts_journal.h"
+#include "src/alerts_utils.h"
+#include <catch2/catch.hpp>
+#include <fty_common_utf8.h>
+#include <unistd.h>
+
+#define SELFTEST_RW "."
+
+// record of mutation 'op' of a new alert
+static void test_journal_record(std::string& batch, uint8_t op, const char* rule, const char* element,
+    const char* state, const char* severity)
+{
+    fty_proto_t* alert = alert_new(rule, element, state, severity, "journaled", 10, nullptr, 0);
+    REQUIRE(alert);
+    std::string encoded = alert_encode_frame(alert);
+    REQUIRE(!encoded.empty());
+    alert_journal_record(batch, op, encoded.data(), encoded.size());
+    fty_proto_destroy(&alert);
+}
+
+TEST_CASE("alerts journal test")
+{
+    const char* state_file = "test_journal_state";
+    alert_journal_remove(SELFTEST_RW, state_file, UINT64_MAX);
+    CHECK(alert_journal_generations(SELFTEST_RW, state_file).empty());
+
+    // crc32 check value
+    CHECK(alert_crc32("123456789", 9) == 0xCBF43926);
+
+    // encoded alert decodes to the same one
+    {
+        fty_proto_t* alert = alert_new("Rule1", "Element1", "ACTIVE", "high", "xyz", 1, nullptr, 0);
+        std::string  encoded = alert_encode_frame(alert);
+        fty_proto_t* decoded = alert_decode_frame(encoded.data(), encoded.size());
+        REQUIRE(decoded);
+        CHECK(alert_comparator(alert, decoded) == 0);
+        CHECK(alert_decode_frame("garbage", 7) == nullptr);
+        fty_proto_destroy(&decoded);
+        fty_proto_destroy(&alert);
+    }
+
+    // two generations, the last one with a torn record at its end
+    {
+        int fd = alert_journal_open(SELFTEST_RW, state_file, 1);
+        REQUIRE(fd != -1);
+        std::string batch;
+        test_journal_record(batch, ALERT_JOURNAL_CREATE, "Rule1", "Element2", "ACTIVE", "high");
+        test_journal_record(batch, ALERT_JOURNAL_ACK, "rule1", "Element1", "ACK-WIP", "high");
+        test_journal_record(batch, ALERT_JOURNAL_CREATE, "Rule2", "Element1", "ACTIVE", "low");
+        CHECK(alert_journal_write(fd, batch) == 0);
+        close(fd);
+
+        fd = alert_journal_open(SELFTEST_RW, state_file, 2);
+        REQUIRE(fd != -1);
+        batch.clear();
+        test_journal_record(batch, ALERT_JOURNAL_PURGE, "Rule2", "Element1", "RESOLVED", "low");
+        test_journal_record(batch, ALERT_JOURNAL_RESOLVE, "Rule1", "Element2", "RESOLVED", "high");
+        std::string torn;
+        test_journal_record(torn, ALERT_JOURNAL_CREATE, "Rule3", "Element1", "ACTIVE", "low");
+        batch.append(torn, 0, torn.size() / 2);
+        CHECK(alert_journal_write(fd, batch) == 0);
+        close(fd);
+
+        // purged, then created again in the same batch (element case differs)
+        fd = alert_journal_open(SELFTEST_RW, state_file, 3);
+        REQUIRE(fd != -1);
+        batch.clear();
+        test_journal_record(batch, ALERT_JOURNAL_CREATE, "Rule4", "Element1", "RESOLVED", "low");
+        test_journal_record(batch, ALERT_JOURNAL_PURGE, "Rule4", "Element1", "RESOLVED", "low");
+        test_journal_record(batch, ALERT_JOURNAL_CREATE, "Rule4", "ELEMENT1", "ACTIVE", "high");
+        CHECK(alert_journal_write(fd, batch) == 0);
+        close(fd);
+    }
+    CHECK(alert_journal_generations(SELFTEST_RW, state_file) == std::vector<uint64_t>({1, 2, 3}));
+
+    // replay onto the saved state
+    {
+        zlistx_t* alerts = zlistx_new();
+        zlistx_set_destructor(alerts, reinterpret_cast<czmq_destructor*>(fty_proto_destroy));
+        zlistx_set_duplicator(alerts, reinterpret_cast<czmq_duplicator*>(fty_proto_dup));
+        fty_proto_t* alert = alert_new("Rule1", "Element1", "ACTIVE", "high", "xyz", 1, nullptr, 0);
+        zlistx_add_end(alerts, alert);
+        fty_proto_destroy(&alert);
+
+        CHECK(alert_journal_replay(alerts, SELFTEST_RW, state_file) == 8);
+        CHECK(zlistx_size(alerts) == 3);
+
+        fty_proto_t* cursor = reinterpret_cast<fty_proto_t*>(zlistx_first(alerts));
+        while (cursor) {
+            if (is_alert_identified(cursor, "Rule1", "Element1"))
+                CHECK(streq(fty_proto_state(cursor), "ACK-WIP"));
+            else if (is_alert_identified(cursor, "Rule4", "Element1"))
+                CHECK(streq(fty_proto_state(cursor), "ACTIVE"));
+            else {
+                CHECK(is_alert_identified(cursor, "Rule1", "Element2"));
+                CHECK(streq(fty_proto_state(cursor), "RESOLVED"));
+            }
+            cursor = reinterpret_cast<fty_proto_t*>(zlistx_next(alerts));
+        }
+        zlistx_destroy(&alerts);
+    }
+
+    // acknowledgement log, an acknowledgement applies to the alert raised at its time only
+    {
+        alert_ack_log_remove(SELFTEST_RW, state_file);
+        int fd = alert_ack_log_open(SELFTEST_RW, state_file);
+        REQUIRE(fd != -1);
+        std::string batch;
+        alert_ack_log_record(batch, "rule1", "Element1", "ACK-WIP", 1);
+        alert_ack_log_record(batch, "Rule1", "Element2", "ACK-SILENCE", 2);
+        alert_ack_log_record(batch, "Rule2", "Element1", "ACK-IGNORE", 1);
+        alert_ack_log_record(batch, "Rule3", "Element1", "ACK-PAUSE", 1);
+        CHECK(alert_journal_write(fd, batch) == 0);
+        // torn record of a write interrupted by a crash
+        batch.clear();
+        alert_ack_log_record(batch, "Rule1", "Element1", "ACK-SILENCE", 1);
+        CHECK(write(fd, batch.data(), batch.size() - 1) == ssize_t(batch.size() - 1));
+        close(fd);
+
+        zlistx_t* alerts = zlistx_new();
+        zlistx_set_destructor(alerts, reinterpret_cast<czmq_destructor*>(fty_proto_destroy));
+        zlistx_set_duplicator(alerts, reinterpret_cast<czmq_duplicator*>(fty_proto_dup));
+        fty_proto_t* alert = alert_new("Rule1", "Element1", "ACTIVE", "high", "xyz", 1, nullptr, 0);
+        zlistx_add_end(alerts, alert);
+        fty_proto_destroy(&alert);
+        // raised again since the acknowledgement
+        alert = alert_new("Rule1", "Element2", "ACTIVE", "high", "xyz", 3, nullptr, 0);
+        zlistx_add_end(alerts, alert);
+        fty_proto_destroy(&alert);
+        alert = alert_new("Rule2", "Element1", "RESOLVED", "low", "xyz", 1, nullptr, 0);
+        zlistx_add_end(alerts, alert);
+        fty_proto_destroy(&alert);
+
+        CHECK(alert_ack_log_replay(alerts, SELFTEST_RW, state_file) == 1);
+        fty_proto_t* cursor = reinterpret_cast<fty_proto_t*>(zlistx_first(alerts));
+        while (cursor) {
+            if (is_alert_identified(cursor, "Rule1", "Element1"))
+                CHECK(streq(fty_proto_state(cursor), "ACK-WIP"));
+            else if (is_alert_identified(cursor, "Rule1", "Element2"))
+                CHECK(streq(fty_proto_state(cursor), "ACTIVE"));
+            else
+                CHECK(streq(fty_proto_state(cursor), "RESOLVED"));
+            cursor = reinterpret_cast<fty_proto_t*>(zlistx_next(alerts));
+        }
+        zlistx_destroy(&alerts);
+
+        alert_ack_log_remove(SELFTEST_RW, state_file);
+        alerts = zlistx_new();
+        CHECK(alert_ack_log_replay(alerts, SELFTEST_RW, state_file) == 0);
+        zlistx_destroy(&alerts);
+    }
+
+    // older generations are removed once compacted
+    alert_journal_remove(SELFTEST_RW, state_file, 3);
+    CHECK(alert_journal_generations(SELFTEST_RW, state_file) == std::vector<uint64_t>({3}));
+    alert_journal_remove(SELFTEST_RW, state_file, UINT64_MAX);
+    CHECK(alert_journal_generations(SELFTEST_RW, state_file).empty());
+}
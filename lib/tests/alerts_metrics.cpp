@@ -0,0 +1,55 @@
+#include "src/alerts_metrics.h"
+#include <catch2/catch.hpp>
+#include <thread>
+#include <vector>
+
+TEST_CASE("alerts metrics test")
+{
+    // empty histogram
+    {
+        AlertHistogram histogram;
+        CHECK(alert_histogram_quantile(histogram, 0.5) == 0);
+        CHECK(histogram.count == 0);
+    }
+
+    // quantiles are bounded by the buckets (powers of 2) and the greatest value
+    {
+        AlertHistogram histogram;
+        for (uint64_t value = 1; value <= 100; value++)
+            alert_histogram_record(histogram, value);
+        CHECK(histogram.count == 100);
+        CHECK(histogram.sum == 5050);
+        CHECK(histogram.max == 100);
+        CHECK(alert_histogram_quantile(histogram, 0.5) == 63);
+        CHECK(alert_histogram_quantile(histogram, 0.99) == 100);
+        CHECK(alert_histogram_quantile(histogram, 0.0) == 1);
+
+        alert_histogram_record(histogram, 0);
+        CHECK(alert_histogram_quantile(histogram, 0.0) == 0);
+
+        // beyond the last bucket
+        alert_histogram_record(histogram, UINT64_MAX);
+        CHECK(histogram.max == UINT64_MAX);
+        CHECK(alert_histogram_quantile(histogram, 1.0) == UINT64_MAX);
+    }
+
+    // concurrent updates are not lost
+    {
+        AlertHistogram           histogram;
+        std::vector<std::thread> threads;
+        for (uint64_t t = 0; t < 4; t++) {
+            threads.emplace_back([&histogram, t]() {
+                for (uint64_t value = 0; value < 10000; value++)
+                    alert_histogram_record(histogram, value * 4 + t);
+            });
+        }
+        for (auto& thread : threads)
+            thread.join();
+        CHECK(histogram.count == 40000);
+        CHECK(histogram.max == 39999);
+        uint64_t total = 0;
+        for (const auto& bucket : histogram.buckets)
+            total += bucket;
+        CHECK(total == 40000);
+    }
+}